@@ -12,13 +12,16 @@
 #include "imgui_impl_dx11.h"
 #include <d3d11.h>
 #include <tchar.h>
-#include <wchar.h> // wprintf
+#include <sddl.h> // pipe security descriptors
+#include "barerg_pipeline.cpp" // launcher, ingest, parsers, result store, run_headless
 
 // Data
 static ID3D11Device*            g_pd3dDevice = nullptr;
 static ID3D11DeviceContext*     g_pd3dDeviceContext = nullptr;
 static IDXGISwapChain*          g_pSwapChain = nullptr;
 static bool                     g_SwapChainOccluded = false;
+static bool                     g_WindowActive = true;
+static bool                     g_WindowMinimized = false;
 static UINT                     g_ResizeWidth = 0, g_ResizeHeight = 0;
 static ID3D11RenderTargetView*  g_mainRenderTargetView = nullptr;
 
@@ -29,344 +32,3321 @@ void CreateRenderTarget();
 void CleanupRenderTarget();
 LRESULT WINAPI WndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam);
 
-// TODO(irwin): remove @cleanup
-enum Pipe_State
+static void show_launch_stats_history(const char *label, const float *history, int count)
 {
-    PipeState_Invalid = 0,
-    // PipeState_RetryingToOpen,
-    PipeState_Open,
+    int sample_count = ImMin(count, LAUNCH_STATS_HISTORY);
+    if (sample_count == 0)
+    {
+        ImGui::Text("%s: no samples", label);
+        return;
+    }
+
+    float min_ms = FLT_MAX;
+    float max_ms = 0.0f;
+    float sum_ms = 0.0f;
+    for (int i = 0; i < sample_count; ++i)
+    {
+        min_ms = ImMin(min_ms, history[i]);
+        max_ms = ImMax(max_ms, history[i]);
+        sum_ms += history[i];
+    }
+    float last_ms = history[(count - 1) % LAUNCH_STATS_HISTORY];
+    ImGui::Text("%s: last %.2f ms, min %.2f, avg %.2f, max %.2f (%d runs)", label, last_ms, min_ms, sum_ms / (float)sample_count, max_ms, sample_count);
+    ImGui::PlotLines("##history", history, sample_count, count >= LAUNCH_STATS_HISTORY ? count % LAUNCH_STATS_HISTORY : 0, 0, 0.0f, max_ms, ImVec2(0, 40.0f));
+}
+
+// NOTE(irwin): runs the --null parser and the text parser over the same captured --null output,
+// with NULs turned back into colons for the text parser, so the two can be compared byte for byte.
+// Runs on the ui thread, it's a one-off from the Stats menu.
+struct Parser_Benchmark
+{
+    bool valid;
+    long long bytes;
+    int text_rows;
+    int null_rows;
+    int mismatched_rows;
+    float text_ms;
+    float null_ms;
+};
+
+static Parser_Benchmark g_ParserBenchmark;
+
+static float parse_benchmark_store(Result_Store *store, const char *text, size_t size, bool nul_to_colon, int *rows)
+{
+    *rows = 0;
+    if (!virtual_buffer_ensure(&store->text, size))
+    {
+        return 0.0f;
+    }
+    memcpy(store->text.base, text, size);
+    if (nul_to_colon)
+    {
+        for (char *at = store->text.base; (at = (char *)memchr(at, 0, (size_t)(store->text.base + size - at))) != 0; ++at)
+        {
+            *at = ':';
+        }
+    }
+    store->text.used = size;
+
+    long long start = get_timestamp();
+    *rows = parse_result_store(store);
+    return timestamp_to_ms(get_timestamp() - start);
+}
+
+static bool can_benchmark_parsers(Result_Store *store)
+{
+    return store->format == Output_Format_Null && !store->spill && store->text.used > 0;
+}
+
+static void run_parser_benchmark(Result_Store *store, Parser_Benchmark *benchmark)
+{
+    *benchmark = {};
+    Result_Store text_store = {};
+    Result_Store null_store = {};
+    if (result_store_init(&text_store, Output_Format_Text, store->row_fields, false) && result_store_init(&null_store, Output_Format_Null, store->row_fields, false))
+    {
+        // NOTE(irwin): only what the ingest thread has already parsed, the rest may still be changing
+        size_t size = (size_t)store->parse_cursor;
+        benchmark->bytes = (long long)size;
+        benchmark->text_ms = parse_benchmark_store(&text_store, store->text.base, size, true, &benchmark->text_rows);
+        benchmark->null_ms = parse_benchmark_store(&null_store, store->text.base, size, false, &benchmark->null_rows);
+
+        // NOTE(irwin): both stores hold the same bytes at the same offsets and intern paths in the
+        // same order, so agreeing parsers produce identical fields; only paths with colons in
+        // them are expected to differ
+        const ParsedLine *text_rows = (const ParsedLine *)text_store.rows.base;
+        const ParsedLine *null_rows = (const ParsedLine *)null_store.rows.base;
+        int common_rows = ImMin(benchmark->text_rows, benchmark->null_rows);
+        benchmark->mismatched_rows = ImMax(benchmark->text_rows, benchmark->null_rows) - common_rows;
+        for (int row_index = 0; row_index < common_rows; ++row_index)
+        {
+            const ParsedLine &text_row = text_rows[row_index];
+            const ParsedLine &null_row = null_rows[row_index];
+            if (text_row.path_id != null_row.path_id ||
+                text_row.line_number != null_row.line_number || text_row.column != null_row.column || text_row.absolute_offset != null_row.absolute_offset ||
+                text_row.match.first != null_row.match.first || text_row.match.one_past_last != null_row.match.one_past_last)
+            {
+                benchmark->mismatched_rows++;
+            }
+        }
+        benchmark->valid = true;
+    }
+    result_store_release(&text_store);
+    result_store_release(&null_store);
+}
+
+static void show_parser_benchmark(Parser_Benchmark *benchmark)
+{
+    if (!benchmark->valid)
+    {
+        return;
+    }
+
+    float megabytes = (float)benchmark->bytes / (1024.0f * 1024.0f);
+    float gigabytes = (float)benchmark->bytes / 1e9f;
+    ImGui::Text("%.1f MB of --null output", megabytes);
+    ImGui::Text("text parser: %.2f ms, %.2f GB/s, %d rows", benchmark->text_ms, gigabytes * 1000.0f / ImMax(benchmark->text_ms, 0.001f), benchmark->text_rows);
+    ImGui::Text("null parser: %.2f ms, %.2f GB/s, %d rows", benchmark->null_ms, gigabytes * 1000.0f / ImMax(benchmark->null_ms, 0.001f), benchmark->null_rows);
+    ImGui::Text("rows that differ: %d", benchmark->mismatched_rows);
+}
+
+// NOTE(irwin): completed searches keyed by query, dir, flags and command line, so flipping back to
+// a query we just had shows its rows without running rg again. Most recently used first, the
+// tail gets evicted once the stores add up to more than the cap. A search is either in here or
+// owned by a tab, never both.
+enum Cache_Revalidate
+{
+    Cache_Revalidate_Never = 0,
+    // NOTE(irwin): only if the searched dir's last write time moved. That only changes when entries
+    // directly in it are added, removed or renamed, edits further down need Always.
+    Cache_Revalidate_If_Dir_Changed,
+    Cache_Revalidate_Always,
+
+    Cache_Revalidate_COUNT
+};
+
+struct Search_Cache
+{
+    Search *first;
+    Search *last;
+    int entry_count;
+    long long memory_used;
+
+    // NOTE(irwin): 0 disables the cache
+    int memory_cap_mb;
+    Cache_Revalidate revalidate;
+
+    int hits;
+    int misses;
+};
+
+static Search_Cache g_SearchCache;
+
+static void search_cache_init(Search_Cache *cache)
+{
+    cache->memory_cap_mb = 256;
+    cache->revalidate = Cache_Revalidate_If_Dir_Changed;
+}
+
+// NOTE(irwin): committed pages, in spill mode that's just the staging area. Nothing changes any of
+// it while the search sits in the cache.
+static inline long long search_memory_size(Search *search)
+{
+    return (long long)(search->store.text.committed + search->store.rows.committed + search->store.paths.names.committed +
+                       search->store.paths.entries.committed + (size_t)search->store.paths.slot_count * sizeof(ImU32)) +
+           sorted_view_memory_size(&search->sorted_view) +
+           (long long)search->dead_rows.Capacity * (long long)sizeof(ImU32) + (long long)search->live_rows.Capacity * (long long)sizeof(int);
+}
+
+static void search_cache_unlink(Search_Cache *cache, Search *search)
+{
+    (search->cache_prev ? search->cache_prev->cache_next : cache->first) = search->cache_next;
+    (search->cache_next ? search->cache_next->cache_prev : cache->last) = search->cache_prev;
+    search->cache_prev = nullptr;
+    search->cache_next = nullptr;
+    cache->entry_count--;
+    cache->memory_used -= search_memory_size(search);
+}
+
+static void search_cache_evict(Search_Cache *cache, long long memory_cap)
+{
+    while (cache->last && cache->memory_used > memory_cap)
+    {
+        Search *search = cache->last;
+        search_cache_unlink(cache, search);
+        destroy_search(search);
+    }
+}
+
+// NOTE(irwin): only a search that ran to completion has the same rows the next rg run would give,
+// anything stopped early (cancelled, over its memory budget, out of reserve) doesn't
+static bool is_search_cacheable(Search *search)
+{
+    Command *command = &search->command;
+    bool finished = !command->started || is_ingest_done(command);
+    return search->key && finished && command->drained && !command->abort_requested;
+}
+
+// NOTE(irwin): takes ownership, the search is destroyed right away if it can't be cached
+static void search_cache_insert(Search_Cache *cache, Search *search)
+{
+    long long memory_cap = (long long)cache->memory_cap_mb * 1024 * 1024;
+    finish_ingest_thread(&search->command);
+    if (search_memory_size(search) > memory_cap)
+    {
+        destroy_search(search);
+        return;
+    }
+
+    search->cache_prev = nullptr;
+    search->cache_next = cache->first;
+    (cache->first ? cache->first->cache_prev : cache->last) = search;
+    cache->first = search;
+    cache->entry_count++;
+    cache->memory_used += search_memory_size(search);
+    search_cache_evict(cache, memory_cap);
+}
+
+// NOTE(irwin): a hit is unlinked and handed to the caller
+static Search *search_cache_take(Search_Cache *cache, const char *key, ImGuiID key_hash)
+{
+    for (Search *search = cache->first; search; search = search->cache_next)
+    {
+        if (search->key_hash == key_hash && strcmp(search->key, key) == 0)
+        {
+            search_cache_unlink(cache, search);
+            cache->hits++;
+            return search;
+        }
+    }
+    cache->misses++;
+    return nullptr;
+}
+
+static void search_cache_clear(Search_Cache *cache)
+{
+    search_cache_evict(cache, -1);
+}
+
+// NOTE(irwin): what a tab lets go of goes into the cache if it's complete, otherwise it's cancelled
+// and reaped in the background like before
+static void release_search(Search *search)
+{
+    if (is_search_cacheable(search))
+    {
+        search_cache_insert(&g_SearchCache, search);
+    }
+    else
+    {
+        retire_search(search);
+    }
+}
+
+// NOTE(irwin): dir is utf8, same as the tab's input. Works for a file as well.
+static bool get_dir_write_time(const char *dir, unsigned long long *write_time)
+{
+    wchar_t *dir_wide = 0;
+    if (!UTF8_ToWidechar(&dir_wide, dir))
+    {
+        return false;
+    }
+
+    WIN32_FILE_ATTRIBUTE_DATA attributes = {};
+    bool ok = GetFileAttributesExW(dir_wide, GetFileExInfoStandard, &attributes) != 0;
+    free(dir_wide);
+    if (ok)
+    {
+        *write_time = ((unsigned long long)attributes.ftLastWriteTime.dwHighDateTime << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+    }
+    return ok;
+}
+
+static inline char ascii_to_lower(char ch)
+{
+    return (ch >= 'A' && ch <= 'Z') ? (char)(ch | 32) : ch;
+}
+
+// NOTE(irwin): first and last byte of the needle compared 16 positions at a time, only positions
+// where both match get a full compare. ignore_case is ascii only, same as ImStrnicmp.
+static bool contains_literal(const char *text, int text_size, const char *needle, int needle_size, bool ignore_case)
+{
+    if (needle_size == 0)
+    {
+        return true;
+    }
+    if (text_size < needle_size)
+    {
+        return false;
+    }
+
+    char first = needle[0];
+    char last = needle[needle_size - 1];
+    const __m128i first_lower = _mm_set1_epi8(ignore_case ? ascii_to_lower(first) : first);
+    const __m128i first_upper = _mm_set1_epi8(ignore_case ? ImToUpper(first) : first);
+    const __m128i last_lower = _mm_set1_epi8(ignore_case ? ascii_to_lower(last) : last);
+    const __m128i last_upper = _mm_set1_epi8(ignore_case ? ImToUpper(last) : last);
+
+    int last_start = text_size - needle_size;
+    int at = 0;
+    for (; at + 16 <= last_start + 1; at += 16)
+    {
+        __m128i block_first = _mm_loadu_si128((const __m128i *)(text + at));
+        __m128i block_last = _mm_loadu_si128((const __m128i *)(text + at + needle_size - 1));
+        __m128i eq_first = _mm_or_si128(_mm_cmpeq_epi8(block_first, first_lower), _mm_cmpeq_epi8(block_first, first_upper));
+        __m128i eq_last = _mm_or_si128(_mm_cmpeq_epi8(block_last, last_lower), _mm_cmpeq_epi8(block_last, last_upper));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_and_si128(eq_first, eq_last));
+        while (mask)
+        {
+            int candidate = at + find_first_set_bit(mask);
+            if (ignore_case ? ImStrnicmp(text + candidate, needle, (size_t)needle_size) == 0 : memcmp(text + candidate, needle, (size_t)needle_size) == 0)
+            {
+                return true;
+            }
+            mask &= mask - 1;
+        }
+    }
+    for (; at <= last_start; ++at)
+    {
+        if (ignore_case ? ImStrnicmp(text + at, needle, (size_t)needle_size) == 0 : memcmp(text + at, needle, (size_t)needle_size) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// NOTE(irwin): no regex syntax at all, so rg matches it as a plain substring
+static bool is_literal_query(const char *query)
+{
+    return query[strcspn(query, ".^$*+?()[]{}|\\")] == 0;
+}
+
+// NOTE(irwin): flags in the user's command that make rg's rows something other than "lines with
+// the query in them, case as the tab says", narrowing would keep the wrong ones
+static bool command_changes_matching(const char *command)
+{
+    static const char *const long_flags[] = {
+        "--invert-match", "--word-regexp", "--line-regexp", "--fixed-strings", "--multiline", "--multiline-dotall",
+        "--ignore-case", "--smart-case", "--only-matching", "--replace", "--regexp", "--file", "--max-count",
+        "--after-context", "--before-context", "--context", "--passthru", "--passthrough", "--null-data",
+    };
+    // NOTE(irwin): the same ones in short form, and the short flags that take a value, the rest of a
+    // token after those is the value
+    static const char short_flags[] = "vwxFUiSoremfABC";
+    static const char short_flags_with_value[] = "ABCEMTdefgjmrt";
+
+    const char *at = command;
+    while (*at)
+    {
+        while (*at == ' ' || *at == '\t')
+        {
+            at++;
+        }
+        const char *token = at;
+        while (*at && *at != ' ' && *at != '\t')
+        {
+            at++;
+        }
+
+        if (token[0] == '-' && token[1] == '-')
+        {
+            size_t name_size = strcspn(token, "= \t");
+            for (const char *flag : long_flags)
+            {
+                if (name_size == strlen(flag) && memcmp(token, flag, name_size) == 0)
+                {
+                    return true;
+                }
+            }
+        }
+        else if (token[0] == '-')
+        {
+            for (const char *ch = token + 1; ch < at; ++ch)
+            {
+                if (strchr(short_flags, *ch))
+                {
+                    return true;
+                }
+                if (strchr(short_flags_with_value, *ch))
+                {
+                    break;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+// NOTE(irwin): the query is the last line of a key, see build_search_key
+static inline const char *search_key_query(const char *key)
+{
+    return strrchr(key, '\n') + 1;
+}
+
+// NOTE(irwin): keeps the rows of `search` whose match contains `query`. `rows` holds row indices
+// into the store, empty means start from every published row. Not for spilled stores, their
+// rows aren't in memory.
+static void narrow_search_rows(Search *search, ImVector<int> *rows, bool all_rows, const char *query, bool ignore_case)
+{
+    Result_Window window;
+    int row_count = result_store_published_row_count(&search->store);
+    result_store_window(&search->store, 0, row_count, &window);
+
+    if (all_rows)
+    {
+        rows->resize(row_count);
+        for (int row = 0; row < row_count; ++row)
+        {
+            (*rows)[row] = row;
+        }
+    }
+
+    int query_size = (int)strlen(query);
+    int kept = 0;
+    for (int index = 0; index < rows->Size; ++index)
+    {
+        int row = (*rows)[index];
+        const ParsedLine *line = window.rows + row;
+        if (contains_literal(window.text + line->match.first, (int)(line->match.one_past_last - line->match.first), query, query_size, ignore_case))
+        {
+            (*rows)[kept++] = row;
+        }
+    }
+    rows->resize(kept);
+}
+
+// NOTE(irwin): the width of a row location without measuring it every frame, it's made of eleven
+// different characters whose advances are looked up once per font and size
+struct Row_Location_Widths
+{
+    ImFont *font;
+    float font_size;
+    float digit_widths[10];
+    float colon_width;
+};
+
+static Row_Location_Widths g_RowLocationWidths;
+
+static float row_location_width(const char *first, const char *one_past_last)
+{
+    Row_Location_Widths *widths = &g_RowLocationWidths;
+    if (widths->font != ImGui::GetFont() || widths->font_size != ImGui::GetFontSize())
+    {
+        widths->font = ImGui::GetFont();
+        widths->font_size = ImGui::GetFontSize();
+        for (int digit = 0; digit < 10; ++digit)
+        {
+            char ch = (char)('0' + digit);
+            widths->digit_widths[digit] = ImGui::CalcTextSize(&ch, &ch + 1).x;
+        }
+        widths->colon_width = ImGui::CalcTextSize(":").x;
+    }
+
+    float width = 0.0f;
+    for (const char *at = first; at < one_past_last; ++at)
+    {
+        width += *at == ':' ? widths->colon_width : widths->digit_widths[*at - '0'];
+    }
+    return width;
+}
+
+// NOTE(irwin): json rows know where their submatches are, highlight them
+static void show_match_text(const char *text, ParsedLine *line)
+{
+    int submatch_count = parsed_line_submatch_count(line);
+    if (submatch_count == 0)
+    {
+        ImGui::TextUnformatted(text + line->match.first, text + line->match.one_past_last);
+        return;
+    }
+
+    const char *match = text + line->match.first;
+    int match_size = (int)(line->match.one_past_last - line->match.first);
+    int written = 0;
+    ImGui::BeginGroup();
+    for (int submatch_index = 0; submatch_index <= submatch_count; ++submatch_index)
+    {
+        Row_Span submatch = { match_size, match_size };
+        if (submatch_index < submatch_count)
+        {
+            submatch = parsed_line_submatch(text, line, submatch_index);
+            // NOTE(irwin): spans may reach into the line terminator we trimmed
+            submatch.first = ImClamp(submatch.first, written, match_size);
+            submatch.one_past_last = ImClamp(submatch.one_past_last, submatch.first, match_size);
+        }
+
+        if (submatch.first > written)
+        {
+            ImGui::TextUnformatted(match + written, match + submatch.first);
+            ImGui::SameLine(0.0f, 0.0f);
+        }
+        if (submatch.one_past_last > submatch.first)
+        {
+            ImGui::PushStyleColor(ImGuiCol_Text, ImGui::GetStyleColorVec4(ImGuiCol_PlotHistogram));
+            ImGui::TextUnformatted(match + submatch.first, match + submatch.one_past_last);
+            ImGui::PopStyleColor();
+            ImGui::SameLine(0.0f, 0.0f);
+        }
+        written = ImMax(written, submatch.one_past_last);
+    }
+    ImGui::NewLine();
+    ImGui::EndGroup();
+}
+
+// NOTE(irwin): rows published by the ingest thread so far, the count is read once and stays
+// stable for the whole frame. With a row_map only those rows are shown, in that order, the store
+// can't be spilled then. sort_by_path orders everything else by (path, line), spilled stores
+// stay in arrival order.
+static void show_search_results(Search *search, const ImVector<int> *row_map, bool sort_by_path, bool *tooltip_pending)
+{
+    int store_row_count = 0;
+    if (search)
+    {
+        store_row_count = result_store_published_row_count(&search->store);
+    }
+    int ripgrep_row_count = row_map ? row_map->Size : store_row_count;
+
+    bool sorted = search && !row_map && sort_by_path && !search->store.spill;
+    if (sorted)
+    {
+        sorted_view_update(&search->sorted_view, &search->store, store_row_count);
+    }
+    ImVector<int> sorted_rows;
+
+    // if (!ripgrep_output_lines.empty())
+    {
+        // if (ImGui::BeginChild("ripgrep output"))
+        {
+            static ImGuiTableFlags flags = ImGuiTableFlags_ScrollY | ImGuiTableFlags_ScrollX | ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersOuter | ImGuiTableFlags_BordersV | ImGuiTableFlags_Resizable | ImGuiTableFlags_Reorderable | ImGuiTableFlags_Hideable;
+
+            // PushStyleCompact();
+            // ImGui::CheckboxFlags("ImGuiTableFlags_ScrollY", &flags, ImGuiTableFlags_ScrollY);
+            // PopStyleCompact();
+
+            // const float TEXT_BASE_WIDTH = ImGui::CalcTextSize("A").x;
+            // const float TEXT_BASE_HEIGHT = ImGui::GetTextLineHeightWithSpacing();
+            // IM_UNUSED(TEXT_BASE_WIDTH);
+
+
+            // When using ScrollX or ScrollY we need to specify a size for our table container!
+            // Otherwise by default the table will fit all available space, like a BeginChild() call.
+            ImVec2 outer_size = ImVec2(0.0f, 0.0f);
+            if (ImGui::BeginTable("ripgrep_table", 4, flags, outer_size))
+            {
+                ImGui::TableSetupScrollFreeze(0, 1); // Make top row always visible
+                ImGui::TableSetupColumn("#", ImGuiTableColumnFlags_None);
+                ImGui::TableSetupColumn("Path", ImGuiTableColumnFlags_None);
+                ImGui::TableSetupColumn("Line", ImGuiTableColumnFlags_None);
+                ImGui::TableSetupColumn("Match", ImGuiTableColumnFlags_None);
+                // ImGui::TableSetupColumn("Three", ImGuiTableColumnFlags_None);
+                ImGui::TableHeadersRow();
+
+                // if (ripgrep_output_lines.empty())
+                // {
+                //     ImGui::TableNextRow();
+                // }
+
+                // Demonstrate using clipper for large vertical lists
+                ImGuiListClipper clipper;
+                clipper.Begin(ripgrep_row_count);
+                int display_end = 0;
+                while (clipper.Step())
+                {
+                    display_end = ImMax(display_end, clipper.DisplayEnd);
+                    Result_Window window;
+                    bool window_ok = row_map || sorted ? result_store_window(&search->store, 0, store_row_count, &window)
+                                                       : result_store_window(&search->store, clipper.DisplayStart, clipper.DisplayEnd - clipper.DisplayStart, &window);
+                    if (!window_ok)
+                    {
+                        break;
+                    }
+                    if (sorted)
+                    {
+                        sorted_rows.resize(clipper.DisplayEnd - clipper.DisplayStart);
+                        sorted_view_select(&search->sorted_view, &search->store, clipper.DisplayStart, sorted_rows.Size, sorted_rows.Data);
+                    }
+                    const char *ripgrep_output = window.text;
+                    for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++)
+                    {
+                        int store_row = row_map ? (*row_map)[row] : sorted ? sorted_rows[row - clipper.DisplayStart] : row;
+                        ParsedLine line = result_window_row(&window, store_row);
+                        ImGui::TableNextRow();
+#if 0
+#else
+
+                        ImGui::TableSetColumnIndex(0);
+                        ImGui::Text("%d", row+1);
+
+                        bool pressed = false;
+                        const char *filepath = result_store_path(&search->store, line.path_id);
+                        ImGui::TableSetColumnIndex(1);
+                        {
+                            ImGui::PushID(row);
+                            pressed = ImGui::Selectable(filepath, false, ImGuiSelectableFlags_SpanAllColumns | ImGuiSelectableFlags_AllowItemOverlap);
+                            if (ImGui::BeginPopupContextItem())
+                            {
+                                Path_Table *paths = &search->store.paths;
+                                Path_Entry *path_entry = path_table_entry(paths, line.path_id);
+                                ImGui::TextDisabled("%d rows in this file", (int)path_entry->row_count);
+                                if (path_entry->dir_id != PATH_ID_NONE)
+                                {
+                                    Path_Entry *dir_entry = path_table_entry(paths, path_entry->dir_id);
+                                    ImGui::TextDisabled("%d rows under %.*s", (int)dir_entry->row_count, dir_entry->name_size,
+                                                        path_table_get(paths, path_entry->dir_id));
+                                }
+                                if (ImGui::MenuItem("Copy row"))
+                                {
+                                    char location[ROW_LOCATION_CAPACITY];
+                                    char *location_end = location + IM_ARRAYSIZE(location);
+                                    ImGuiTextBuffer to_copy;
+                                    to_copy.append(filepath);
+                                    to_copy.appendf("%s", ":");
+                                    to_copy.append(format_row_location(&line, location_end), location_end);
+                                    to_copy.appendf("%s", ":");
+                                    to_copy.append(ripgrep_output + line.match.first, ripgrep_output + line.match.one_past_last);
+                                    ImGui::SetClipboardText(to_copy.c_str());
+                                }
+                                ImGui::EndPopup();
+                            }
+                            ImGui::PopID();
+                        }
+
+                        ImGui::TableSetColumnIndex(2);
+                        {
+                            char location[ROW_LOCATION_CAPACITY];
+                            const char *line_one_past_last = location + IM_ARRAYSIZE(location);
+                            const char *line_first = format_row_location(&line, location + IM_ARRAYSIZE(location));
+                            // ImGui::SetNextItemWidth(-ImGui::CalcTextSize(line_first, line_one_past_last).x);
+                            ImGui::SetCursorPosX(ImGui::GetCursorPosX() + (ImGui::GetContentRegionAvail().x - row_location_width(line_first, line_one_past_last)) - 3.0f);
+
+                            // ImGui::SetNextItemWidth(-ImGui::GetContentRegionAvail().x);
+                            // ImGui::SetNextItemWidth(-FLT_MIN);
+                            // ImGui::SetNextItemWidth(-100.0f);
+                            ImGui::TextUnformatted(line_first, line_one_past_last);
+
+                            if (pressed)
+                            {
+                                ImGuiTextBuffer buf;
+                                buf.append("C:\\Program Files (x86)\\Notepad++\\notepad++.exe");
+
+                                ImGuiTextBuffer buf2;
+                                buf2.appendf("\"%s\"", filepath);
+                                buf2.appendf(" -n%d", line.line_number);
+                                if (line.column > 0)
+                                {
+                                    buf2.appendf(" -c%d", line.column);
+                                }
+
+                                ShellExecuteA(NULL, "open", buf.c_str(), buf2.c_str(), NULL, 0);
+                            }
+                        }
+#endif
+
+                        // ImGui::TextUnformatted(line_first, line_one_past_last);
+                        // ImGui::Text("%.*s", line_one_past_last - line_first, line_first);
+
+
+                        ImGui::TableSetColumnIndex(3);
+                        show_match_text(ripgrep_output, &line);
+                        if (ImGui::BeginItemTooltip())
+                        {
+                            ImGui::PushTextWrapPos(ImGui::GetFontSize() * 35.0f);
+                            ImGui::TextUnformatted(ripgrep_output + line.match.first, ripgrep_output + line.match.one_past_last);
+                            ImGui::PopTextWrapPos();
+                            if (line.absolute_offset >= 0)
+                            {
+                                ImGui::TextDisabled("byte offset %lld", line.absolute_offset);
+                            }
+                            ImGui::EndTooltip();
+                        }
+                        else if (ImGui::IsItemHovered())
+                        {
+                            *tooltip_pending = true;
+                        }
+
+                    }
+                }
+
+                // NOTE(irwin): scrolled close to the end of what's loaded, let rg continue
+                const int LOAD_MORE_ROWS_AHEAD = 1000;
+                if (search && !row_map && is_ingest_paused(&search->command) && display_end + LOAD_MORE_ROWS_AHEAD >= ripgrep_row_count)
+                {
+                    continue_command(&search->command, search->byte_budget_step);
+                }
+                if (search && !row_map)
+                {
+                    search->display_end = display_end;
+                }
+                ImGui::EndTable();
+            }
+        }
+        // ImGui::EndChild();
+    }
+    // else
+    {
+        // ImGui::Text("Ripgrep output empty");
+    }
+}
+
+// NOTE(irwin): ReadDirectoryChangesW on a tab's dir, recursive, on a thread of its own. Changed
+// paths are collected as "dir\\name" in utf8, the way rg prints them for that dir, NUL separated,
+// and the main loop gets woken up. Nothing here touches imgui, its allocator counts allocations
+// in the context without any locking.
+struct Dir_Watcher
+{
+    char dir[1024];
+    wchar_t *dir_wide;
+    bool include_hidden;
+
+    HANDLE directory;
+    HANDLE io_event;
+    HANDLE stop_event;
+    HANDLE wake_event;
+    HANDLE thread;
+    DWORD buffer[16 * 1024];
+
+    SRWLOCK lock;
+    char *changed;
+    int changed_size;
+    int changed_capacity;
+    long long last_change_timestamp;
+    // NOTE(irwin): changes got lost (the buffer overflowed or the watch failed), only a full run
+    // can catch up
+    volatile LONG overflowed;
+};
+
+// NOTE(irwin): rg skips hidden files and dirs unless told not to, so do we, most of the noise is in .git
+static bool is_hidden_path(const char *relative_path)
+{
+    for (const char *at = relative_path; *at; ++at)
+    {
+        if (*at == '.' && (at == relative_path || at[-1] == '\\'))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void dir_watcher_push(Dir_Watcher *watcher, const char *relative_path)
+{
+    int dir_size = (int)strlen(watcher->dir);
+    bool needs_separator = dir_size > 0 && watcher->dir[dir_size - 1] != '\\' && watcher->dir[dir_size - 1] != '/';
+    int size = dir_size + (needs_separator ? 1 : 0) + (int)strlen(relative_path) + 1;
+
+    AcquireSRWLockExclusive(&watcher->lock);
+    if (watcher->changed_size + size > watcher->changed_capacity)
+    {
+        int new_capacity = ImMax(watcher->changed_capacity * 2, watcher->changed_size + size + 4096);
+        char *changed = (char *)realloc(watcher->changed, (size_t)new_capacity);
+        if (!changed)
+        {
+            ReleaseSRWLockExclusive(&watcher->lock);
+            InterlockedExchange(&watcher->overflowed, 1);
+            return;
+        }
+        watcher->changed = changed;
+        watcher->changed_capacity = new_capacity;
+    }
+    char *write = watcher->changed + watcher->changed_size;
+    memcpy(write, watcher->dir, (size_t)dir_size);
+    write += dir_size;
+    if (needs_separator)
+    {
+        *write++ = '\\';
+    }
+    strcpy(write, relative_path);
+    watcher->changed_size += size;
+    watcher->last_change_timestamp = get_timestamp();
+    ReleaseSRWLockExclusive(&watcher->lock);
+}
+
+static void dir_watcher_collect(Dir_Watcher *watcher, DWORD bytes)
+{
+    const char *at = (const char *)watcher->buffer;
+    const char *end = at + bytes;
+    while (at < end)
+    {
+        const FILE_NOTIFY_INFORMATION *info = (const FILE_NOTIFY_INFORMATION *)at;
+        int name_size = (int)(info->FileNameLength / sizeof(wchar_t));
+        char relative_path[MAX_PATH * 4];
+        int relative_size = WideCharToMultiByte(CP_UTF8, 0, info->FileName, name_size, relative_path, IM_ARRAYSIZE(relative_path) - 1, 0, 0);
+        if (relative_size > 0)
+        {
+            relative_path[relative_size] = 0;
+
+            bool skip = !watcher->include_hidden && is_hidden_path(relative_path);
+            if (!skip && info->Action == FILE_ACTION_MODIFIED)
+            {
+                // NOTE(irwin): a dir is "modified" whenever anything in it changes, its entries
+                // report for themselves
+                wchar_t full_path[MAX_PATH * 2];
+                int dir_size = (int)wcslen(watcher->dir_wide);
+                if (dir_size + 1 + name_size < IM_ARRAYSIZE(full_path))
+                {
+                    memcpy(full_path, watcher->dir_wide, dir_size * sizeof(wchar_t));
+                    full_path[dir_size] = L'\\';
+                    memcpy(full_path + dir_size + 1, info->FileName, name_size * sizeof(wchar_t));
+                    full_path[dir_size + 1 + name_size] = 0;
+                    DWORD attributes = GetFileAttributesW(full_path);
+                    skip = attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY);
+                }
+            }
+            if (!skip)
+            {
+                dir_watcher_push(watcher, relative_path);
+            }
+        }
+
+        if (!info->NextEntryOffset)
+        {
+            break;
+        }
+        at += info->NextEntryOffset;
+    }
+}
+
+static DWORD WINAPI dir_watcher_thread_proc(LPVOID parameter)
+{
+    Dir_Watcher *watcher = (Dir_Watcher *)parameter;
+    HANDLE wait_handles[2] = { watcher->io_event, watcher->stop_event };
+    DWORD filter = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE;
+    for (;;)
+    {
+        OVERLAPPED overlapped = {};
+        overlapped.hEvent = watcher->io_event;
+        if (!ReadDirectoryChangesW(watcher->directory, watcher->buffer, sizeof(watcher->buffer), TRUE, filter, 0, &overlapped, 0))
+        {
+            Win32OutputLastError();
+            InterlockedExchange(&watcher->overflowed, 1);
+            SetEvent(watcher->wake_event);
+            break;
+        }
+
+        DWORD bytes = 0;
+        if (WaitForMultipleObjects(IM_ARRAYSIZE(wait_handles), wait_handles, FALSE, INFINITE) != WAIT_OBJECT_0)
+        {
+            // NOTE(irwin): the buffer belongs to the read until it's really cancelled
+            CancelIoEx(watcher->directory, &overlapped);
+            GetOverlappedResult(watcher->directory, &overlapped, &bytes, TRUE);
+            break;
+        }
+
+        // NOTE(irwin): zero bytes is ERROR_NOTIFY_ENUM_DIR, more changed than fit in the buffer
+        if (!GetOverlappedResult(watcher->directory, &overlapped, &bytes, FALSE) || bytes == 0)
+        {
+            InterlockedExchange(&watcher->overflowed, 1);
+        }
+        else
+        {
+            dir_watcher_collect(watcher, bytes);
+        }
+        SetEvent(watcher->wake_event);
+    }
+    return 0;
+}
+
+static void destroy_dir_watcher(Dir_Watcher *watcher)
+{
+    if (watcher->thread)
+    {
+        SetEvent(watcher->stop_event);
+        WaitForSingleObject(watcher->thread, INFINITE);
+    }
+    close_tracked_handle(&watcher->thread);
+    close_tracked_handle(&watcher->directory);
+    close_tracked_handle(&watcher->io_event);
+    close_tracked_handle(&watcher->stop_event);
+    free(watcher->dir_wide);
+    free(watcher->changed);
+    free(watcher);
+}
+
+static Dir_Watcher *create_dir_watcher(const char *dir, bool include_hidden, HANDLE wake_event)
+{
+    Dir_Watcher *watcher = (Dir_Watcher *)calloc(1, sizeof(Dir_Watcher));
+    if (!watcher)
+    {
+        return nullptr;
+    }
+    ImStrncpy(watcher->dir, dir, IM_ARRAYSIZE(watcher->dir));
+    watcher->include_hidden = include_hidden;
+    watcher->wake_event = wake_event;
+    if (!UTF8_ToWidechar(&watcher->dir_wide, dir))
+    {
+        destroy_dir_watcher(watcher);
+        return nullptr;
+    }
+
+    HANDLE directory = CreateFileW(watcher->dir_wide, FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, 0,
+                                   OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, 0);
+    if (directory == INVALID_HANDLE_VALUE)
+    {
+        Win32OutputLastError();
+        destroy_dir_watcher(watcher);
+        return nullptr;
+    }
+    watcher->directory = directory;
+    track_handle_opened(watcher->directory);
+
+    watcher->io_event = CreateEventW(0, FALSE, FALSE, 0);
+    track_handle_opened(watcher->io_event);
+    watcher->stop_event = CreateEventW(0, TRUE, FALSE, 0);
+    track_handle_opened(watcher->stop_event);
+    if (watcher->io_event && watcher->stop_event)
+    {
+        watcher->thread = CreateThread(0, 0, dir_watcher_thread_proc, watcher, 0, 0);
+        track_handle_opened(watcher->thread);
+    }
+    if (!watcher->thread)
+    {
+        Win32OutputLastError();
+        destroy_dir_watcher(watcher);
+        return nullptr;
+    }
+    return watcher;
+}
+
+// NOTE(irwin): hands over what changed since the last call, the caller frees it.
+// last_change_timestamp is 0 if nothing did.
+static char *dir_watcher_take(Dir_Watcher *watcher, int *size, long long *last_change_timestamp)
+{
+    AcquireSRWLockExclusive(&watcher->lock);
+    char *changed = watcher->changed;
+    *size = watcher->changed_size;
+    *last_change_timestamp = watcher->changed_size ? watcher->last_change_timestamp : 0;
+    watcher->changed = nullptr;
+    watcher->changed_size = 0;
+    watcher->changed_capacity = 0;
+    ReleaseSRWLockExclusive(&watcher->lock);
+    return changed;
+}
+
+static long long dir_watcher_last_change(Dir_Watcher *watcher)
+{
+    AcquireSRWLockShared(&watcher->lock);
+    long long timestamp = watcher->changed_size ? watcher->last_change_timestamp : 0;
+    ReleaseSRWLockShared(&watcher->lock);
+    return timestamp;
+}
+
+// NOTE(irwin): one tab per independent search, each with its own inputs and result store.
+// Tabs don't launch rg themselves, they queue a request and the scheduler picks it up.
+struct Search_Tab
+{
+    int id;
+    char query[1024];
+    char dir[1024];
+    bool ignore_case;
+    bool spill_to_disk;
+    // NOTE(irwin): only changes how rows are shown, doesn't rerun rg
+    bool sort_by_path;
+    Output_Format output_format;
+    // NOTE(irwin): Row_Field_Flags
+    int row_fields;
+    char search_command[1024];
+
+    Search *search;
+    long long next_search_schedule_when_typing;
+    // NOTE(irwin): waiting for the scheduler, requested_timestamp orders the queue
+    bool search_pending;
+    long long requested_timestamp;
+
+    // NOTE(irwin): search came out of the cache. A revalidation run goes on in the background and
+    // replaces it once it's done, the cached rows stay up until then.
+    bool showing_cached;
+    bool revalidation_pending;
+    Search *revalidation;
+
+    // NOTE(irwin): typed a literal query that contains the previous one, every row it can match is
+    // already in the previous search. narrow_rows are the rows of narrow_source that contain
+    // narrow_query, shown until the fresh rg run for it is done.
+    Search *narrow_source;
+    ImVector<int> narrow_rows;
+    char narrow_query[1024];
+
+    // NOTE(irwin): live mode, files that change under watched_dir get searched again once things
+    // settle and their rows replace the old ones in place. watched_dir is the dir of the last
+    // requested search, the watcher follows it.
+    bool live;
+    char watched_dir[1024];
+    Dir_Watcher *watcher;
+};
+
+static Search_Tab *create_search_tab(Search_Tab *copy_from)
+{
+    static int next_tab_id = 1;
+
+    Search_Tab *tab = (Search_Tab *)calloc(1, sizeof(Search_Tab));
+    tab->id = next_tab_id++;
+    tab->next_search_schedule_when_typing = LLONG_MAX;
+    if (copy_from)
+    {
+        ImStrncpy(tab->query, copy_from->query, IM_ARRAYSIZE(tab->query));
+        ImStrncpy(tab->dir, copy_from->dir, IM_ARRAYSIZE(tab->dir));
+        ImStrncpy(tab->search_command, copy_from->search_command, IM_ARRAYSIZE(tab->search_command));
+        tab->ignore_case = copy_from->ignore_case;
+        tab->spill_to_disk = copy_from->spill_to_disk;
+        tab->sort_by_path = copy_from->sort_by_path;
+        tab->output_format = copy_from->output_format;
+        tab->row_fields = copy_from->row_fields;
+        tab->live = copy_from->live;
+        ImStrncpy(tab->watched_dir, copy_from->watched_dir, IM_ARRAYSIZE(tab->watched_dir));
+    }
+    else
+    {
+        ImStrncpy(tab->query, "imgui", IM_ARRAYSIZE(tab->query));
+        ImStrncpy(tab->dir, "c:\\proj\\cpp", IM_ARRAYSIZE(tab->dir));
+        ImStrncpy(tab->search_command, "rg.exe --line-number", IM_ARRAYSIZE(tab->search_command));
+    }
+    return tab;
+}
+
+static void stop_narrowing(Search_Tab *tab)
+{
+    if (tab->narrow_source)
+    {
+        release_search(tab->narrow_source);
+        tab->narrow_source = nullptr;
+    }
+    tab->narrow_rows.clear();
+}
+
+static void destroy_search_tab(Search_Tab *tab)
+{
+    if (tab->search)
+    {
+        release_search(tab->search);
+    }
+    if (tab->revalidation)
+    {
+        retire_search(tab->revalidation);
+    }
+    // NOTE(irwin): also frees narrow_rows, ImVector::clear() deallocates
+    stop_narrowing(tab);
+    if (tab->watcher)
+    {
+        destroy_dir_watcher(tab->watcher);
+    }
+    free(tab);
+}
+
+static inline bool is_search_running(Search *search)
+{
+    return search && search->command.started && !is_ingest_done(&search->command);
+}
+
+// NOTE(irwin): --threads is left out on purpose, it changes how fast rg is, not what it prints.
+// The query goes last, so two keys that only differ in the query share everything up to it.
+static void build_search_key(Search_Tab *tab, char *key, int key_capacity)
+{
+    ImFormatString(key, (size_t)key_capacity, "%s\n%d\n%d\n%d\n%s\n%s", tab->search_command, (int)tab->ignore_case, (int)tab->output_format, tab->row_fields,
+                   tab->dir, tab->query);
+}
+
+static bool same_search_except_query(const char *key, const char *other_key)
+{
+    size_t prefix_size = (size_t)(search_key_query(key) - key);
+    return strncmp(key, other_key, prefix_size) == 0 && search_key_query(other_key) - other_key == (ptrdiff_t)prefix_size;
+}
+
+// NOTE(irwin): narrows the current view further if there is one, otherwise starts from the rows
+// of `previous`, which is the tab's search up to now. Anything still running there gets cancelled,
+// what it published so far is what we narrow. True if `previous` is owned by the narrowing now.
+static bool try_narrowing(Search_Tab *tab, Search *previous, const char *key)
+{
+    // NOTE(irwin): the previous search has the same command, same_search_except_query checks that
+    if (!is_literal_query(tab->query) || command_changes_matching(tab->search_command))
+    {
+        // NOTE(irwin): rows narrowed for an earlier query don't stand in for this one either
+        stop_narrowing(tab);
+        return false;
+    }
+
+    if (tab->narrow_source && same_search_except_query(tab->narrow_source->key, key) && strstr(tab->query, tab->narrow_query))
+    {
+        narrow_search_rows(tab->narrow_source, &tab->narrow_rows, false, tab->query, tab->ignore_case);
+        ImStrncpy(tab->narrow_query, tab->query, IM_ARRAYSIZE(tab->narrow_query));
+        return false;
+    }
+
+    stop_narrowing(tab);
+    if (!previous || previous->store.spill || !previous->key)
+    {
+        return false;
+    }
+    const char *previous_query = search_key_query(previous->key);
+    if (!same_search_except_query(previous->key, key) || !is_literal_query(previous_query) || !strstr(tab->query, previous_query))
+    {
+        return false;
+    }
+
+    cancel_command(&previous->command);
+    tab->narrow_source = previous;
+    if (previous->patched)
+    {
+        // NOTE(irwin): dead rows are gone from live_rows, and it's already in the order shown
+        tab->narrow_rows = previous->live_rows;
+        narrow_search_rows(previous, &tab->narrow_rows, false, tab->query, tab->ignore_case);
+    }
+    else if (tab->sort_by_path)
+    {
+        // NOTE(irwin): narrowed rows keep the order they were shown in
+        sorted_view_update(&previous->sorted_view, &previous->store, result_store_published_row_count(&previous->store));
+        sorted_view_compact(&previous->sorted_view, &previous->store);
+        tab->narrow_rows = previous->sorted_view.order;
+        narrow_search_rows(previous, &tab->narrow_rows, false, tab->query, tab->ignore_case);
+    }
+    else
+    {
+        narrow_search_rows(previous, &tab->narrow_rows, true, tab->query, tab->ignore_case);
+    }
+    ImStrncpy(tab->narrow_query, tab->query, IM_ARRAYSIZE(tab->narrow_query));
+    return true;
+}
+
+static bool should_revalidate(Search *search, const char *dir)
+{
+    switch (g_SearchCache.revalidate)
+    {
+        case Cache_Revalidate_Never:
+        {
+            return false;
+        } break;
+
+        case Cache_Revalidate_If_Dir_Changed:
+        {
+            unsigned long long write_time = 0;
+            return !search->dir_write_time || !get_dir_write_time(dir, &write_time) || write_time != search->dir_write_time;
+        } break;
+
+        default:
+        {
+            return true;
+        } break;
+    }
+}
+
+// NOTE(irwin): the tab's previous search goes into the cache, unless it's what we narrow. It isn't
+// looked up again, so Run on an unchanged search always runs rg.
+static void request_tab_search(Search_Tab *tab)
+{
+    tab->next_search_schedule_when_typing = LLONG_MAX;
+    if (tab->revalidation)
+    {
+        retire_search(tab->revalidation);
+        tab->revalidation = nullptr;
+    }
+    tab->showing_cached = false;
+    tab->revalidation_pending = false;
+    tab->search_pending = false;
+    tab->requested_timestamp = get_timestamp();
+
+    // NOTE(irwin): the new run sees everything that changed so far. A watcher on another dir gets
+    // recreated by update_tab_live.
+    ImStrncpy(tab->watched_dir, tab->dir, IM_ARRAYSIZE(tab->watched_dir));
+    if (tab->watcher)
+    {
+        int changed_size = 0;
+        long long last_change_timestamp = 0;
+        free(dir_watcher_take(tab->watcher, &changed_size, &last_change_timestamp));
+        InterlockedExchange(&tab->watcher->overflowed, 0);
+    }
+
+    char key[IM_ARRAYSIZE(tab->search_command) + IM_ARRAYSIZE(tab->query) + IM_ARRAYSIZE(tab->dir) + 32];
+    build_search_key(tab, key, IM_ARRAYSIZE(key));
+
+    Search *previous = tab->search;
+    tab->search = nullptr;
+    Search *cached = search_cache_take(&g_SearchCache, key, ImHashStr(key));
+    if (cached)
+    {
+        stop_narrowing(tab);
+        tab->search = cached;
+        tab->showing_cached = true;
+        tab->revalidation_pending = should_revalidate(cached, tab->dir);
+    }
+    else
+    {
+        tab->search_pending = true;
+    }
+
+    bool previous_narrowed = !cached && try_narrowing(tab, previous, key);
+    if (previous && !previous_narrowed)
+    {
+        release_search(previous);
+    }
+}
+
+// NOTE(irwin): the narrowed rows stand in for the fresh run until it's done, or until it stops
+// on its memory budget, the usual "Load more" takes over from there. A launch that failed
+// leaves nothing to wait for.
+static void update_tab_narrowing(Search_Tab *tab)
+{
+    if (tab->narrow_source && !tab->search_pending && (!is_search_running(tab->search) || is_ingest_paused(&tab->search->command)))
+    {
+        stop_narrowing(tab);
+    }
+}
+
+// NOTE(irwin): swaps the revalidation run in once it's done. One that ran into its memory budget
+// won't finish on its own, it gets swapped in as well and continues the usual way.
+static void update_tab_revalidation(Search_Tab *tab)
+{
+    Search *revalidation = tab->revalidation;
+    if (revalidation && (!is_search_running(revalidation) || is_ingest_paused(&revalidation->command)))
+    {
+        // NOTE(irwin): stale, the fresh one has the same key and gets cached in its place
+        retire_search(tab->search);
+        tab->search = revalidation;
+        tab->revalidation = nullptr;
+        tab->showing_cached = false;
+    }
+}
+
+static void show_search_tab(Search_Tab *tab, bool *tooltip_pending)
+{
+    bool run_pressed = false;
+
+    if (ImGui::GetIO().KeyCtrl && ImGui::IsKeyPressed(ImGuiKey_F) && !ImGui::IsAnyItemActive())
+    {
+        ImGui::SetKeyboardFocusHere();
+    }
+    if(ImGui::InputText("ripgrep_query", tab->query, IM_ARRAYSIZE(tab->query)))
+    {
+        tab->next_search_schedule_when_typing = get_timestamp() + (g_TimestampFrequency >> 2);
+    }
+    else
+    {
+        // run_pressed |= ImGui::IsItemDeactivatedAfterEdit();
+    }
+
+    ImGui::InputText("ripgrep_dir", tab->dir, IM_ARRAYSIZE(tab->dir));
+    run_pressed |= ImGui::IsItemDeactivatedAfterEdit();
+
+    // TODO(irwin): when we have separate input field for search term, restart search if time since last input
+    //              change is greater than ~20-100 ms
+    run_pressed |= ImGui::Checkbox("ignore_case", &tab->ignore_case);
+    ImGui::SameLine();
+    run_pressed |= ImGui::Checkbox("spill_to_disk", &tab->spill_to_disk);
+    ImGui::SetItemTooltip("Keep rows in temp files instead of memory, for result sets too big to fit.\nThe memory budget doesn't apply.");
+    ImGui::SameLine();
+    ImGui::Checkbox("sort_by_path", &tab->sort_by_path);
+    ImGui::SetItemTooltip("Show rows ordered by path and line as they arrive, rg keeps running on all threads.\nNot available with spill_to_disk.");
+    ImGui::SameLine();
+    ImGui::Checkbox("live", &tab->live);
+    ImGui::SetItemTooltip("Watch ripgrep_dir and search changed files again once a search is done, their rows are replaced in place.\n"
+                          "Changed files are given to rg by name, so ignore files don't apply to them.\n"
+                          "With spill_to_disk, or when too much changed at once, the whole search runs again.");
+    ImGui::SameLine();
+    {
+        static const char *output_format_names[Output_Format_COUNT] = { "text", "json", "null", "heading" };
+        int output_format = tab->output_format;
+        ImGui::SetNextItemWidth(ImGui::GetFontSize() * 5.0f);
+        if (ImGui::Combo("output", &output_format, output_format_names, Output_Format_COUNT))
+        {
+            tab->output_format = (Output_Format)output_format;
+            run_pressed = true;
+        }
+        ImGui::SetItemTooltip("json runs rg with --json: exact paths, byte offsets and highlighted matches\n"
+                              "null runs rg with --null: paths end at a NUL, so colons in them are fine\n"
+                              "heading runs rg with --heading: each path is sent once per file instead of once per match");
+    }
+    ImGui::SameLine();
+    run_pressed |= ImGui::CheckboxFlags("column", &tab->row_fields, Row_Field_Column);
+    ImGui::SetItemTooltip("Run rg with --column, rows show line:column and open there.");
+    ImGui::SameLine();
+    run_pressed |= ImGui::CheckboxFlags("byte_offset", &tab->row_fields, Row_Field_Byte_Offset);
+    ImGui::SetItemTooltip("Run rg with --byte-offset, the match tooltip shows it.");
+    ImGui::SameLine();
+
+    ImGui::InputText("ripgrep_search_command", tab->search_command, IM_ARRAYSIZE(tab->search_command));
+    run_pressed |= ImGui::IsItemDeactivatedAfterEdit();
+
+    Search *search = tab->search;
+    run_pressed |= ImGui::Button("Run ripgrep");
+    ImGui::SameLine();
+    ImGui::BeginDisabled(!is_search_running(search) || search->command.abort_requested);
+    if(ImGui::Button("Stop"))
+    {
+        cancel_command(&search->command);
+    }
+    ImGui::SameLine();
+    if (ImGui::Button(search && search->user_paused ? "Resume" : "Pause"))
+    {
+        search->user_paused = !search->user_paused;
+    }
+    ImGui::EndDisabled();
+
+
+    ImGui::SameLine();
+    if (tab->narrow_source)
+    {
+        ImGui::Text("%d matches", tab->narrow_rows.Size);
+        ImGui::SameLine();
+        ImGui::TextDisabled(tab->search_pending ? "(narrowed, waiting for a free rg slot)" : "(narrowed, rg running)");
+    }
+    else if (tab->search_pending)
+    {
+        ImGui::TextDisabled("waiting for a free rg slot");
+    }
+    else if (search && is_ingest_paused(&search->command) && !search->command.abort_requested)
+    {
+        ImGui::Text("%d rows loaded, more available", result_store_published_row_count(&search->store));
+        ImGui::SameLine();
+        if (ImGui::SmallButton("Load more"))
+        {
+            continue_command(&search->command, search->byte_budget_step);
+        }
+    }
+    else if (search && search->patched)
+    {
+        ImGui::Text("%d matches", search->live_rows.Size);
+        ImGui::SameLine();
+        ImGui::TextDisabled(search->patch_running ? "(live, updating)" : "(live)");
+    }
+    else
+    {
+        ImGui::Text("%d matches", search ? result_store_published_row_count(&search->store) : 0);
+    }
+    if (is_search_running(search) && search->command.suspended)
+    {
+        ImGui::SameLine();
+        ImGui::TextDisabled(search->user_paused ? "(paused)" : search->far_ahead_of_reader ? "(rg suspended, scroll down to continue)" : "(rg suspended)");
+    }
+    else if (is_search_running(search) && search->command.throttled)
+    {
+        ImGui::SameLine();
+        ImGui::TextDisabled("(rg at low priority)");
+    }
+    if (tab->showing_cached)
+    {
+        ImGui::SameLine();
+        ImGui::TextDisabled(tab->revalidation || tab->revalidation_pending ? "(cached, revalidating)" : "(cached)");
+    }
+    if (search && search->command.spawn_timestamp)
+    {
+        // NOTE(irwin): written by the ingest thread, a stale zero just shows up a frame later
+        long long first_byte_timestamp = search->command.first_byte_timestamp;
+        if (first_byte_timestamp)
+        {
+            ImGui::SameLine();
+            ImGui::TextDisabled("(first byte after %.1f ms, -j%d)", timestamp_to_ms(first_byte_timestamp - search->command.spawn_timestamp), search->thread_count);
+        }
+    }
+
+    if (run_pressed || get_timestamp() >= tab->next_search_schedule_when_typing)
+    {
+        request_tab_search(tab);
+    }
+
+    if (tab->narrow_source)
+    {
+        show_search_results(tab->narrow_source, &tab->narrow_rows, false, tooltip_pending);
+    }
+    else if (tab->search && tab->search->patched)
+    {
+        show_search_results(tab->search, &tab->search->live_rows, false, tooltip_pending);
+    }
+    else
+    {
+        show_search_results(tab->search, nullptr, tab->sort_by_path, tooltip_pending);
+    }
+}
+
+// NOTE(irwin): the label is the query, ### keeps the id stable while it's being typed
+static void show_search_tabs(ImVector<Search_Tab *> *tabs, Search_Tab **focused_tab, bool *tooltip_pending)
+{
+    if (ImGui::BeginTabBar("search_tabs", ImGuiTabBarFlags_Reorderable | ImGuiTabBarFlags_AutoSelectNewTabs | ImGuiTabBarFlags_FittingPolicyScroll))
+    {
+        if (ImGui::TabItemButton("+", ImGuiTabItemFlags_Trailing | ImGuiTabItemFlags_NoTooltip))
+        {
+            tabs->push_back(create_search_tab(*focused_tab));
+        }
+
+        for (int tab_index = 0; tab_index < tabs->Size;)
+        {
+            Search_Tab *tab = (*tabs)[tab_index];
+
+            char label[256];
+            ImFormatString(label, IM_ARRAYSIZE(label), "%s%.64s###tab%d", is_search_running(tab->search) || tab->search_pending ? "* " : "", tab->query, tab->id);
+
+            bool open = true;
+            if (ImGui::BeginTabItem(label, tabs->Size > 1 ? &open : nullptr))
+            {
+                *focused_tab = tab;
+                ImGui::PushID(tab->id);
+                show_search_tab(tab, tooltip_pending);
+                ImGui::PopID();
+                ImGui::EndTabItem();
+            }
+            else if (get_timestamp() >= tab->next_search_schedule_when_typing)
+            {
+                // NOTE(irwin): typed into, then switched away before the debounce fired
+                request_tab_search(tab);
+            }
+
+            if (!open)
+            {
+                if (*focused_tab == tab)
+                {
+                    *focused_tab = nullptr;
+                }
+                destroy_search_tab(tab);
+                tabs->erase(tabs->Data + tab_index);
+            }
+            else
+            {
+                tab_index++;
+            }
+        }
+        ImGui::EndTabBar();
+    }
+}
+
+// NOTE(irwin): caps how many rg run at once and splits the -j budget between them. One slot is
+// always kept for the focused tab and background searches share at most half of the threads,
+// so five background searches can't starve the one being typed into. The focused tab's rg also
+// runs at normal priority while the rest run below normal.
+struct Search_Scheduler
+{
+    int max_concurrent;
+    int thread_budget;
+    // NOTE(irwin): per search, text plus rows. 0 means unlimited.
+    int memory_budget_mb;
+    // NOTE(irwin): rg gets suspended once it's this many rows past the end of the table's view,
+    // nobody reads that far without scrolling. 0 means never.
+    int suspend_rows_ahead;
+};
+
+static void scheduler_init(Search_Scheduler *scheduler)
+{
+    scheduler->thread_budget = ImMax(1, (int)GetActiveProcessorCount(ALL_PROCESSOR_GROUPS));
+    scheduler->max_concurrent = 4;
+    scheduler->memory_budget_mb = 512;
+    scheduler->suspend_rows_ahead = 100000;
+}
+
+// NOTE(irwin): `shown` is whether the table is showing this search's rows, only then does
+// display_end say anything about how far the user got
+static void update_search_priority(Search_Scheduler *scheduler, Search *search, bool shown)
+{
+    if (!is_search_running(search))
+    {
+        return;
+    }
+
+    int rows_ahead = result_store_published_row_count(&search->store) - search->display_end;
+    int limit = scheduler->suspend_rows_ahead;
+    if (!shown || limit <= 0)
+    {
+        search->far_ahead_of_reader = false;
+    }
+    else if (rows_ahead > limit)
+    {
+        search->far_ahead_of_reader = true;
+    }
+    else if (rows_ahead < limit / 2)
+    {
+        search->far_ahead_of_reader = false;
+    }
+
+    bool suspend = search->user_paused || g_WindowMinimized || search->far_ahead_of_reader;
+    set_command_suspended(&search->command, suspend);
+    set_command_throttled(&search->command, suspend || !g_WindowActive);
+}
+
+// NOTE(irwin): runs every loop iteration, even while minimized and not rendering. Only the focused
+// tab's table is drawn, the others' display_end is wherever they were left.
+static void update_search_priorities(Search_Scheduler *scheduler, ImVector<Search_Tab *> *tabs, Search_Tab *focused_tab)
+{
+    for (Search_Tab *tab : *tabs)
+    {
+        update_search_priority(scheduler, tab->search, tab == focused_tab && tab->narrow_source == nullptr);
+        update_search_priority(scheduler, tab->revalidation, false);
+    }
+}
+
+static void launcher_begin_tab_command(Search_Tab *tab, int thread_count, bool with_filename)
+{
+    launcher_begin_search_command(tab->search_command, tab->ignore_case, tab->output_format, tab->row_fields, tab->query, thread_count, with_filename);
+}
+
+// NOTE(irwin): pipe names are global, any local user can create ours first and wait for what we
+// send it. Our pipes have the user's SID in their name and a DACL that lets only that user in, and
+// a client checks that whoever serves the pipe runs as that user before it writes anything.
+// Set up once at startup, before any pipe is opened.
+struct User_Pipe_Security
+{
+    bool valid;
+    BYTE token_user[sizeof(TOKEN_USER) + SECURITY_MAX_SID_SIZE];
+    char sid_utf8[192];
+    PSECURITY_DESCRIPTOR descriptor;
+    SECURITY_ATTRIBUTES attributes;
+};
+
+static User_Pipe_Security g_UserPipeSecurity;
+
+// NOTE(irwin): buffer holds a TOKEN_USER followed by the SID it points at
+static bool get_process_user(HANDLE process, BYTE *buffer, DWORD buffer_size)
+{
+    HANDLE token = 0;
+    if (!OpenProcessToken(process, TOKEN_QUERY, &token))
+    {
+        return false;
+    }
+    DWORD size = 0;
+    BOOL ok = GetTokenInformation(token, TokenUser, buffer, buffer_size, &size);
+    CloseHandle(token);
+    return ok != 0;
+}
+
+static void user_pipe_security_init(User_Pipe_Security *security)
+{
+    *security = {};
+    if (!get_process_user(GetCurrentProcess(), security->token_user, sizeof(security->token_user)))
+    {
+        Win32OutputLastError();
+        return;
+    }
+    wchar_t *sid = 0;
+    if (!ConvertSidToStringSidW(((TOKEN_USER *)security->token_user)->User.Sid, &sid))
+    {
+        Win32OutputLastError();
+        return;
+    }
+    int sid_size = WideCharToMultiByte(CP_UTF8, 0, sid, -1, security->sid_utf8, IM_ARRAYSIZE(security->sid_utf8), 0, 0);
+    LocalFree(sid);
+    if (sid_size == 0)
+    {
+        Win32OutputLastError();
+        return;
+    }
+
+    // NOTE(irwin): protected DACL, full access for the user and nobody else
+    char sddl_utf8[256];
+    ImFormatString(sddl_utf8, IM_ARRAYSIZE(sddl_utf8), "D:P(A;;GA;;;%s)", security->sid_utf8);
+    wchar_t sddl[256];
+    MultiByteToWideChar(CP_UTF8, 0, sddl_utf8, -1, sddl, IM_ARRAYSIZE(sddl));
+    if (!ConvertStringSecurityDescriptorToSecurityDescriptorW(sddl, SDDL_REVISION_1, &security->descriptor, 0))
+    {
+        Win32OutputLastError();
+        return;
+    }
+    security->attributes.nLength = sizeof(security->attributes);
+    security->attributes.lpSecurityDescriptor = security->descriptor;
+    security->attributes.bInheritHandle = FALSE;
+    security->valid = true;
+}
+
+static const int PIPE_NAME_CAPACITY = 256;
+
+// NOTE(irwin): `kind` goes in the middle, one name per user and logon session. False if there's no
+// SID to put in it, the pipe isn't used then.
+static bool get_user_pipe_name(const char *kind, wchar_t *name, int name_capacity)
+{
+    if (!g_UserPipeSecurity.valid)
+    {
+        return false;
+    }
+    DWORD session_id = 0;
+    ProcessIdToSessionId(GetCurrentProcessId(), &session_id);
+    char name_utf8[256];
+    ImFormatString(name_utf8, IM_ARRAYSIZE(name_utf8), "\\\\.\\pipe\\barerg-%s-%s-%u", kind, g_UserPipeSecurity.sid_utf8, (unsigned)session_id);
+    return MultiByteToWideChar(CP_UTF8, 0, name_utf8, -1, name, name_capacity) != 0;
+}
+
+// NOTE(irwin): client side, before anything is written to the pipe
+static bool is_pipe_server_same_user(HANDLE pipe)
+{
+    ULONG server_process_id = 0;
+    if (!g_UserPipeSecurity.valid || !GetNamedPipeServerProcessId(pipe, &server_process_id))
+    {
+        return false;
+    }
+    HANDLE process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, server_process_id);
+    if (!process)
+    {
+        return false;
+    }
+    BYTE token_user[sizeof(TOKEN_USER) + SECURITY_MAX_SID_SIZE];
+    bool same_user = get_process_user(process, token_user, sizeof(token_user)) &&
+                     EqualSid(((TOKEN_USER *)token_user)->User.Sid, ((TOKEN_USER *)g_UserPipeSecurity.token_user)->User.Sid);
+    CloseHandle(process);
+    return same_user;
+}
+
+// NOTE(irwin): optional search daemon, `barerg --daemon`. It runs rg and sends back rg's raw
+// stdout, the client's own ingest thread parses it into the store as if it came from rg, so
+// everything past the pipe is the same. Identical searches running at the same time share one rg.
+// Fixed size, utf8, version first. The answer ends with a trailer, see DAEMON_TRAILER_PREFIX.
+static const ImU32 DAEMON_PROTOCOL_VERSION = 3;
+
+struct Daemon_Request
+{
+    ImU32 version;
+    int ignore_case;
+    int output_format;
+    int row_fields;
+    int thread_count;
+    // NOTE(irwin): don't answer from a run that already finished, revalidations ask for this
+    int fresh;
+    char search_command[1024];
+    char query[1024];
+    char dir[1024];
+};
+
+struct Search_Daemon_Client
+{
+    bool enabled;
+    volatile LONG sent;
+    volatile LONG unreachable;
+};
+
+static Search_Daemon_Client g_SearchDaemonClient;
+
+static void build_daemon_key(const Daemon_Request *request, char *key, int key_capacity)
+{
+    ImFormatString(key, (size_t)key_capacity, "%s\n%d\n%d\n%d\n%s\n%s", request->search_command, request->ignore_case, request->output_format, request->row_fields,
+                   request->dir, request->query);
+}
+
+// NOTE(irwin): like start_search, but stdout_read is a pipe to the daemon. False if there's no
+// daemon to talk to, the caller runs rg itself then. rg flags come from the request, --pre
+// included, so it only goes to a daemon that runs as this user.
+static bool start_remote_search(Search *search, const Daemon_Request *request, HANDLE wake_event)
+{
+    Command *command = &search->command;
+    command->spawn_timestamp = get_timestamp();
+
+    wchar_t name[PIPE_NAME_CAPACITY];
+    if (!get_user_pipe_name("daemon", name, IM_ARRAYSIZE(name)))
+    {
+        InterlockedIncrement(&g_SearchDaemonClient.unreachable);
+        return false;
+    }
+    HANDLE pipe = CreateFileW(name, GENERIC_READ | GENERIC_WRITE, 0, 0, OPEN_EXISTING, 0, 0);
+    if (pipe == INVALID_HANDLE_VALUE && GetLastError() == ERROR_PIPE_BUSY && WaitNamedPipeW(name, 100))
+    {
+        pipe = CreateFileW(name, GENERIC_READ | GENERIC_WRITE, 0, 0, OPEN_EXISTING, 0, 0);
+    }
+    if (pipe == INVALID_HANDLE_VALUE)
+    {
+        InterlockedIncrement(&g_SearchDaemonClient.unreachable);
+        return false;
+    }
+    if (!is_pipe_server_same_user(pipe))
+    {
+        CloseHandle(pipe);
+        InterlockedIncrement(&g_SearchDaemonClient.unreachable);
+        return false;
+    }
+
+    DWORD written = 0;
+    if (!WriteFile(pipe, request, sizeof(*request), &written, 0) || written != sizeof(*request))
+    {
+        CloseHandle(pipe);
+        InterlockedIncrement(&g_SearchDaemonClient.unreachable);
+        return false;
+    }
+
+    command->stdout_read = pipe;
+    track_handle_opened(command->stdout_read);
+    command->remote = true;
+    command->spawned_timestamp = get_timestamp();
+    command->started = true;
+    if (!start_ingest_thread(command, &search->store, wake_event, search->byte_budget_step))
+    {
+        finish_ingest_thread(command);
+        return false;
+    }
+    InterlockedIncrement(&g_SearchDaemonClient.sent);
+    return true;
+}
+
+// NOTE(irwin): a revalidation run goes to tab->revalidation and leaves the cached search on screen
+static bool launch_tab_search(Search_Tab *tab, int thread_count, bool foreground, long long byte_budget, HANDLE wake_event)
+{
+    bool revalidation = tab->revalidation_pending;
+
+    launcher_begin_tab_command(tab, thread_count, false);
+    launcher_append_argument(&g_Launcher, tab->dir);
+
+    tab->search_pending = false;
+    tab->revalidation_pending = false;
+    wchar_t *command_line = launcher_finish(&g_Launcher);
+    if (!command_line)
+    {
+        return false;
+    }
+
+    Search *search = create_search(tab->output_format, tab->row_fields, tab->spill_to_disk);
+    if (!search)
+    {
+        return false;
+    }
+    search->thread_count = thread_count;
+    search->byte_budget_step = byte_budget;
+    search->command.foreground = foreground;
+
+    char key[IM_ARRAYSIZE(tab->search_command) + IM_ARRAYSIZE(tab->query) + IM_ARRAYSIZE(tab->dir) + 32];
+    build_search_key(tab, key, IM_ARRAYSIZE(key));
+    search->key = ImStrdup(key);
+    search->key_hash = ImHashStr(key);
+    // NOTE(irwin): before rg starts, so a change made while it runs still counts as a change
+    get_dir_write_time(tab->dir, &search->dir_write_time);
+
+    bool started = false;
+    if (g_SearchDaemonClient.enabled)
+    {
+        Daemon_Request request = {};
+        request.version = DAEMON_PROTOCOL_VERSION;
+        request.ignore_case = tab->ignore_case;
+        request.output_format = tab->output_format;
+        request.row_fields = tab->row_fields;
+        request.thread_count = thread_count;
+        request.fresh = revalidation;
+        ImStrncpy(request.search_command, tab->search_command, IM_ARRAYSIZE(request.search_command));
+        ImStrncpy(request.query, tab->query, IM_ARRAYSIZE(request.query));
+        ImStrncpy(request.dir, tab->dir, IM_ARRAYSIZE(request.dir));
+        started = start_remote_search(search, &request, wake_event);
+        if (!started)
+        {
+            // NOTE(irwin): no daemon, run rg ourselves
+            search->command = {};
+            search->command.foreground = foreground;
+        }
+    }
+    if (!started && !start_search(search, command_line, wake_event))
+    {
+        // TODO(irwin): we need to remove broken command if we don't want it to be retried ad infinitum
+        destroy_search(search);
+        return false;
+    }
+    if (revalidation)
+    {
+        tab->revalidation = search;
+    }
+    else
+    {
+        tab->search = search;
+    }
+    return true;
+}
+
+// NOTE(irwin): whether `path` is `changed` or something inside it, rg prints the dir as given and
+// joins with '\', NTFS doesn't care about case
+static bool is_path_under(const char *path, int path_size, const char *changed, int changed_size)
+{
+    if (path_size < changed_size)
+    {
+        return false;
+    }
+    for (int i = 0; i < changed_size; ++i)
+    {
+        char a = path[i] == '/' ? '\\' : ascii_to_lower(path[i]);
+        char b = changed[i] == '/' ? '\\' : ascii_to_lower(changed[i]);
+        if (a != b)
+        {
+            return false;
+        }
+    }
+    return path_size == changed_size || path[changed_size] == '\\' || path[changed_size] == '/';
+}
+
+static inline bool is_row_dead(Search *search, int row)
+{
+    return row < search->dead_rows.Size * 32 && (search->dead_rows[row >> 5] & (1u << (row & 31))) != 0;
+}
+
+// NOTE(irwin): every path is checked against the changes once, not once per row. Runs between
+// ingest threads, the rows that die come off their paths' counts here.
+static void mark_dead_rows(Search *search, int row_count, const ImVector<const char *> *changed)
+{
+    Result_Window window;
+    result_store_window(&search->store, 0, row_count, &window);
+    search->dead_rows.resize((row_count + 31) / 32, 0);
+
+    int path_count = (int)InterlockedCompareExchange(&search->store.published_path_count, 0, 0);
+    ImVector<ImS8> path_changed;
+    path_changed.resize(path_count, -1);
+    for (int row = 0; row < row_count; ++row)
+    {
+        const ParsedLine *line = window.rows + row;
+        ImS8 *is_changed = &path_changed[(int)line->path_id];
+        if (*is_changed < 0)
+        {
+            const char *path = result_store_path(&search->store, line->path_id);
+            int path_size = result_store_path_size(&search->store, line->path_id);
+            *is_changed = 0;
+            for (const char *changed_path : *changed)
+            {
+                if (is_path_under(path, path_size, changed_path, (int)strlen(changed_path)))
+                {
+                    *is_changed = 1;
+                    break;
+                }
+            }
+        }
+        if (*is_changed && !is_row_dead(search, row))
+        {
+            search->dead_rows[row >> 5] |= 1u << (row & 31);
+            path_table_add_rows(&search->store.paths, line->path_id, -1);
+        }
+    }
+}
+
+static void rebuild_live_rows(Search *search, bool sort_by_path)
+{
+    int row_count = result_store_published_row_count(&search->store);
+    search->live_rows.resize(0);
+    if (sort_by_path)
+    {
+        sorted_view_update(&search->sorted_view, &search->store, row_count);
+        sorted_view_compact(&search->sorted_view, &search->store);
+        for (int row : search->sorted_view.order)
+        {
+            if (!is_row_dead(search, row))
+            {
+                search->live_rows.push_back(row);
+            }
+        }
+    }
+    else
+    {
+        for (int row = 0; row < row_count; ++row)
+        {
+            if (!is_row_dead(search, row))
+            {
+                search->live_rows.push_back(row);
+            }
+        }
+    }
+    search->live_rows_sorted = sort_by_path;
+}
+
+static bool command_includes_hidden(const char *command)
+{
+    return strstr(command, "--hidden") || strstr(command, "-uu") || strstr(command, "-.");
+}
+
+// NOTE(irwin): only a complete search of exactly what the tab shows gets updated, a spilled one by
+// running it again
+static bool can_patch_tab_search(Search_Tab *tab)
+{
+    Search *search = tab->search;
+    if (!search || search->command.started || !search->command.drained || !search->key ||
+        tab->search_pending || tab->next_search_schedule_when_typing != LLONG_MAX || tab->narrow_source ||
+        tab->revalidation || tab->revalidation_pending)
+    {
+        return false;
+    }
+    char key[IM_ARRAYSIZE(tab->search_command) + IM_ARRAYSIZE(tab->query) + IM_ARRAYSIZE(tab->dir) + 32];
+    build_search_key(tab, key, IM_ARRAYSIZE(key));
+    return strcmp(key, search->key) == 0;
+}
+
+static int compare_changed_paths(const void *a, const void *b)
+{
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+// NOTE(irwin): reruns rg on just the changed paths, into the same store. Rows are appended, the old
+// rows of those paths are marked dead, and live_rows keeps showing the previous state until the
+// patch is done. False if it can't be done that way, the caller reruns the whole search.
+static bool launch_tab_patch(Search_Tab *tab, ImVector<const char *> *changed, HANDLE wake_event)
+{
+    Search *search = tab->search;
+    launcher_begin_tab_command(tab, search->thread_count, true);
+    for (const char *changed_path : *changed)
+    {
+        launcher_append_argument(&g_Launcher, changed_path);
+    }
+    wchar_t *command_line = launcher_finish(&g_Launcher);
+    if (!command_line)
+    {
+        return false;
+    }
+
+    int row_count = result_store_published_row_count(&search->store);
+    if (!search->patched)
+    {
+        rebuild_live_rows(search, tab->sort_by_path);
+        search->patched = true;
+    }
+    mark_dead_rows(search, row_count, changed);
+
+    bool foreground = search->command.foreground;
+    search->command = {};
+    search->command.foreground = foreground;
+    search->store.heading_in_block = false;
+    // NOTE(irwin): a handful of files, no budget
+    search->byte_budget_step = 0;
+    if (!start_search(search, command_line, wake_event))
+    {
+        return false;
+    }
+    search->patch_running = true;
+    return true;
+}
+
+// NOTE(irwin): changes are only taken once none came in for a while, an editor saving a file
+// touches it more than once and a checkout touches thousands
+static inline long long live_patch_due_timestamp(Search_Tab *tab)
+{
+    long long last_change_timestamp = tab->watcher ? dir_watcher_last_change(tab->watcher) : 0;
+    return last_change_timestamp ? last_change_timestamp + g_TimestampFrequency / 5 : LLONG_MAX;
+}
+
+static void update_tab_live(Search_Tab *tab, HANDLE wake_event)
+{
+    bool include_hidden = command_includes_hidden(tab->search_command);
+    if (tab->watcher && (!tab->live || strcmp(tab->watcher->dir, tab->watched_dir) != 0 || tab->watcher->include_hidden != include_hidden))
+    {
+        destroy_dir_watcher(tab->watcher);
+        tab->watcher = nullptr;
+    }
+    if (tab->live && !tab->watcher && tab->watched_dir[0])
+    {
+        tab->watcher = create_dir_watcher(tab->watched_dir, include_hidden, wake_event);
+        if (!tab->watcher)
+        {
+            tab->live = false;
+        }
+    }
+
+    Search *search = tab->search;
+    if (search && search->patch_running && !search->command.started)
+    {
+        search->patch_running = false;
+        rebuild_live_rows(search, tab->sort_by_path);
+    }
+    if (search && search->patched && !search->patch_running && search->live_rows_sorted != tab->sort_by_path)
+    {
+        rebuild_live_rows(search, tab->sort_by_path);
+    }
+
+    if (!tab->watcher || !can_patch_tab_search(tab))
+    {
+        return;
+    }
+    if (InterlockedExchange(&tab->watcher->overflowed, 0))
+    {
+        request_tab_search(tab);
+        return;
+    }
+    if (get_timestamp() < live_patch_due_timestamp(tab))
+    {
+        return;
+    }
+    if (tab->search->store.spill)
+    {
+        // NOTE(irwin): the rows aren't all in memory to be marked dead
+        request_tab_search(tab);
+        return;
+    }
+
+    int changed_size = 0;
+    long long last_change_timestamp = 0;
+    char *changed_paths = dir_watcher_take(tab->watcher, &changed_size, &last_change_timestamp);
+    ImVector<const char *> changed;
+    for (int at = 0; at < changed_size; at += (int)strlen(changed_paths + at) + 1)
+    {
+        changed.push_back(changed_paths + at);
+    }
+    if (changed.Size > 0)
+    {
+        qsort(changed.Data, (size_t)changed.Size, sizeof(const char *), compare_changed_paths);
+        int unique = 1;
+        for (int i = 1; i < changed.Size; ++i)
+        {
+            if (strcmp(changed[i], changed[unique - 1]) != 0)
+            {
+                changed[unique++] = changed[i];
+            }
+        }
+        changed.resize(unique);
+
+        if (!launch_tab_patch(tab, &changed, wake_event))
+        {
+            request_tab_search(tab);
+        }
+    }
+    free(changed_paths);
+}
+
+// NOTE(irwin): standing queries that rerun on their own at idle priority. Rows are kept only as
+// fingerprints, the output is spilled to disk while it's being read, so a million-row audit costs
+// 24 bytes a row between runs. Each run is compared against the previous one and what's left is
+// the delta: rows that showed up and rows that went away.
+struct Row_Fingerprint
+{
+    // NOTE(irwin): mix of the path's hash, line and a hash of the line's text. Runs are compared on
+    // key, then path_id and line, a key alone can collide.
+    ImU64 key;
+    ImU32 path_id;
+    ImU32 line;
+    // NOTE(irwin): row in the run it came from, only valid until that run's store is gone
+    int row;
+};
+
+static inline ImU64 hash_bytes_64(const char *data, int size)
+{
+    // NOTE(irwin): FNV-1a
+    ImU64 hash = 0xcbf29ce484222325ull;
+    for (int i = 0; i < size; ++i)
+    {
+        hash = (hash ^ (ImU8)data[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static inline ImU64 mix_64(ImU64 value)
+{
+    // NOTE(irwin): splitmix64 finalizer
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+    return value ^ (value >> 31);
+}
+
+static inline int compare_fingerprints(const Row_Fingerprint *a, const Row_Fingerprint *b)
+{
+    if (a->key != b->key)
+    {
+        return a->key < b->key ? -1 : 1;
+    }
+    if (a->path_id != b->path_id)
+    {
+        return a->path_id < b->path_id ? -1 : 1;
+    }
+    return a->line < b->line ? -1 : a->line > b->line ? 1 : 0;
+}
+
+// NOTE(irwin): LSD radix sort on key, a byte at a time, passes where every key has the same byte
+// are skipped. What's left is an insertion sort over the few rows that share a key.
+static void sort_fingerprints(ImVector<Row_Fingerprint> *fingerprints, ImVector<Row_Fingerprint> *scratch)
+{
+    int count = fingerprints->Size;
+    scratch->resize(count);
+    Row_Fingerprint *source = fingerprints->Data;
+    Row_Fingerprint *destination = scratch->Data;
+    for (int shift = 0; shift < 64; shift += 8)
+    {
+        int offsets[256] = {};
+        for (int i = 0; i < count; ++i)
+        {
+            offsets[(source[i].key >> shift) & 0xff]++;
+        }
+        if (count == 0 || offsets[(source[0].key >> shift) & 0xff] == count)
+        {
+            continue;
+        }
+        int sum = 0;
+        for (int bucket = 0; bucket < 256; ++bucket)
+        {
+            int bucket_count = offsets[bucket];
+            offsets[bucket] = sum;
+            sum += bucket_count;
+        }
+        for (int i = 0; i < count; ++i)
+        {
+            destination[offsets[(source[i].key >> shift) & 0xff]++] = source[i];
+        }
+        ImSwap(source, destination);
+    }
+    if (source != fingerprints->Data)
+    {
+        memcpy(fingerprints->Data, source, (size_t)count * sizeof(Row_Fingerprint));
+    }
+    scratch->clear();
+
+    // NOTE(irwin): rows with the same key go by path_id and line, runs of equal keys are almost
+    // always a single row
+    Row_Fingerprint *rows = fingerprints->Data;
+    for (int i = 1; i < count; ++i)
+    {
+        Row_Fingerprint row = rows[i];
+        int at = i;
+        while (at > 0 && compare_fingerprints(&row, &rows[at - 1]) < 0)
+        {
+            rows[at] = rows[at - 1];
+            at--;
+        }
+        rows[at] = row;
+    }
+}
+
+// NOTE(irwin): how many delta rows are listed, the counts are always exact
+static const int SAVED_SEARCH_DELTA_LIST_MAX = 1000;
+
+struct Saved_Search
+{
+    char name[128];
+    char query[1024];
+    char dir[1024];
+    char search_command[1024];
+    bool ignore_case;
+    bool enabled;
+    int interval_minutes;
+
+    // NOTE(irwin): 0 runs on the next iteration
+    long long next_run_timestamp;
+    Search *run;
+    // NOTE(irwin): a row of the current run couldn't be fingerprinted, it can't be diffed
+    bool run_failed;
+    int fingerprinted_rows;
+    ImVector<Row_Fingerprint> fingerprints;
+
+    // NOTE(irwin): sorted fingerprints of the last completed run
+    bool has_baseline;
+    ImVector<Row_Fingerprint> baseline;
+    Path_Table paths;
+
+    // NOTE(irwin): what the last completed run changed, one "+ path:line: text" or "- path:line" per line
+    int added;
+    int removed;
+    int row_count;
+    SYSTEMTIME last_run_time;
+    bool last_run_failed;
+    ImGuiTextBuffer delta;
+};
+
+static ImVector<Saved_Search *> g_SavedSearches;
+
+static Saved_Search *create_saved_search(const char *name)
+{
+    Saved_Search *saved = IM_NEW(Saved_Search)();
+    ImStrncpy(saved->name, name, IM_ARRAYSIZE(saved->name));
+    saved->enabled = true;
+    saved->interval_minutes = 60;
+    g_SavedSearches.push_back(saved);
+    return saved;
+}
+
+static void destroy_saved_search(Saved_Search *saved)
+{
+    if (saved->run)
+    {
+        retire_search(saved->run);
+    }
+    g_SavedSearches.find_erase(saved);
+    path_table_release(&saved->paths);
+    IM_DELETE(saved);
+}
+
+static void saved_search_schedule_next(Saved_Search *saved)
+{
+    saved->next_run_timestamp = get_timestamp() + (long long)ImMax(1, saved->interval_minutes) * 60 * g_TimestampFrequency;
+}
+
+static bool launch_saved_search(Saved_Search *saved, int thread_count, HANDLE wake_event)
+{
+    // NOTE(irwin): --null so the path is exact whatever it contains
+    launcher_begin_search_command(saved->search_command, saved->ignore_case, Output_Format_Null, 0, saved->query, thread_count, true);
+    launcher_append_argument(&g_Launcher, saved->dir);
+    wchar_t *command_line = launcher_finish(&g_Launcher);
+    if (!command_line)
+    {
+        return false;
+    }
+
+    Search *search = create_search(Output_Format_Null, 0, true);
+    if (!search)
+    {
+        return false;
+    }
+    search->thread_count = thread_count;
+    search->command.foreground = false;
+    if (!start_search(search, command_line, wake_event))
+    {
+        destroy_search(search);
+        return false;
+    }
+    set_command_throttled(&search->command, true);
+    saved->run = search;
+    saved->run_failed = false;
+    saved->fingerprinted_rows = 0;
+    saved->fingerprints.resize(0);
+    return true;
+}
+
+// NOTE(irwin): a window at a time, spilled rows are only mapped that far
+static void fingerprint_new_rows(Saved_Search *saved)
+{
+    Result_Store *store = &saved->run->store;
+    int row_count = result_store_published_row_count(store);
+    while (!saved->run_failed && saved->fingerprinted_rows < row_count)
+    {
+        int first_row = saved->fingerprinted_rows;
+        int batch = ImMin(4096, row_count - first_row);
+        Result_Window window;
+        if (!result_store_window(store, first_row, batch, &window))
+        {
+            return;
+        }
+        for (int row = first_row; row < first_row + batch; ++row)
+        {
+            ParsedLine line = result_window_row(&window, row);
+            ImU32 line_number = (ImU32)line.line_number;
+
+            // NOTE(irwin): the run's path ids start over every run, the saved search's don't
+            Row_Fingerprint fingerprint;
+            fingerprint.path_id = path_table_intern(&saved->paths, result_store_path(store, line.path_id), result_store_path_size(store, line.path_id));
+            if (fingerprint.path_id == PATH_ID_NONE)
+            {
+                saved->run_failed = true;
+                return;
+            }
+            fingerprint.line = line_number;
+            fingerprint.row = row;
+            ImU64 text_hash = hash_bytes_64(window.text + line.match.first, (int)(line.match.one_past_last - line.match.first));
+            // NOTE(irwin): the path's hash rather than its id, ids change when the table is rebuilt
+            ImU32 path_hash = path_table_entry(&saved->paths, fingerprint.path_id)->hash;
+            fingerprint.key = mix_64(text_hash ^ mix_64(((ImU64)path_hash << 32) | line_number));
+            saved->fingerprints.push_back(fingerprint);
+        }
+        saved->fingerprinted_rows += batch;
+    }
+}
+
+struct Delta_Sort_Context
+{
+    Path_Table *paths;
+};
+
+static Delta_Sort_Context g_DeltaSortContext;
+
+static int compare_delta_rows(const void *a, const void *b)
+{
+    const Row_Fingerprint *row_a = (const Row_Fingerprint *)a;
+    const Row_Fingerprint *row_b = (const Row_Fingerprint *)b;
+    int result = row_a->path_id == row_b->path_id ? 0 : strcmp(path_table_get(g_DeltaSortContext.paths, row_a->path_id), path_table_get(g_DeltaSortContext.paths, row_b->path_id));
+    if (result == 0)
+    {
+        result = row_a->line < row_b->line ? -1 : row_a->line > row_b->line ? 1 : 0;
+    }
+    return result;
+}
+
+static void append_delta_rows(Saved_Search *saved, ImVector<Row_Fingerprint> *rows, bool added)
+{
+    g_DeltaSortContext.paths = &saved->paths;
+    qsort(rows->Data, (size_t)rows->Size, sizeof(Row_Fingerprint), compare_delta_rows);
+    for (const Row_Fingerprint &row : *rows)
+    {
+        const char *path = path_table_get(&saved->paths, row.path_id);
+        Result_Window window;
+        if (added && result_store_window(&saved->run->store, row.row, 1, &window))
+        {
+            ParsedLine line = result_window_row(&window, row.row);
+            saved->delta.appendf("+ %s:%u: %.*s\n", path, row.line, (int)(line.match.one_past_last - line.match.first), window.text + line.match.first);
+        }
+        else
+        {
+            saved->delta.appendf("%c %s:%u\n", added ? '+' : '-', path, row.line);
+        }
+    }
+}
 
-    PipeState_COUNT
-};
+// NOTE(irwin): the table only needs the paths the baseline has, the rest would pile up run after
+// run. The ids change so the baseline is sorted again, the keys don't depend on them.
+static void rebuild_saved_search_paths(Saved_Search *saved)
+{
+    Path_Table paths = {};
+    ImVector<ImU32> new_ids;
+    new_ids.resize(saved->paths.entry_count, PATH_ID_NONE);
+    for (Row_Fingerprint &row : saved->baseline)
+    {
+        ImU32 *new_id = &new_ids[(int)row.path_id];
+        if (*new_id == PATH_ID_NONE)
+        {
+            *new_id = path_table_intern(&paths, path_table_get(&saved->paths, row.path_id), path_table_size(&saved->paths, row.path_id));
+            if (*new_id == PATH_ID_NONE)
+            {
+                // NOTE(irwin): keep the old table, it still has every path
+                path_table_release(&paths);
+                return;
+            }
+        }
+    }
+    for (Row_Fingerprint &row : saved->baseline)
+    {
+        row.path_id = new_ids[(int)row.path_id];
+    }
+    path_table_release(&saved->paths);
+    saved->paths = paths;
 
+    ImVector<Row_Fingerprint> scratch;
+    sort_fingerprints(&saved->baseline, &scratch);
+}
 
-struct Command
+// NOTE(irwin): both sides sorted the same way, a single merge finds what's only on one side.
+// Equal rows pair up one to one, so rows repeated on the same line still count right.
+static void diff_saved_search(Saved_Search *saved)
 {
-    bool started;
-    bool abort_requested;
-    HANDLE stdout_read;
-    HANDLE stdout_write;
-    PROCESS_INFORMATION process_information;
-    Pipe_State pipe_state;
-};
+    ImVector<Row_Fingerprint> scratch;
+    sort_fingerprints(&saved->fingerprints, &scratch);
+
+    ImVector<Row_Fingerprint> added_rows;
+    ImVector<Row_Fingerprint> removed_rows;
+    saved->added = 0;
+    saved->removed = 0;
+    if (saved->has_baseline)
+    {
+        const Row_Fingerprint *current = saved->fingerprints.Data;
+        const Row_Fingerprint *current_end = current + saved->fingerprints.Size;
+        const Row_Fingerprint *previous = saved->baseline.Data;
+        const Row_Fingerprint *previous_end = previous + saved->baseline.Size;
+        while (current < current_end || previous < previous_end)
+        {
+            int order = previous == previous_end ? -1 : current == current_end ? 1 : compare_fingerprints(current, previous);
+            if (order < 0)
+            {
+                if (saved->added++ < SAVED_SEARCH_DELTA_LIST_MAX)
+                {
+                    added_rows.push_back(*current);
+                }
+                current++;
+            }
+            else if (order > 0)
+            {
+                if (saved->removed++ < SAVED_SEARCH_DELTA_LIST_MAX)
+                {
+                    removed_rows.push_back(*previous);
+                }
+                previous++;
+            }
+            else
+            {
+                current++;
+                previous++;
+            }
+        }
+    }
+
+    saved->delta.clear();
+    append_delta_rows(saved, &added_rows, true);
+    append_delta_rows(saved, &removed_rows, false);
 
+    saved->row_count = saved->fingerprints.Size;
+    saved->baseline.swap(saved->fingerprints);
+    saved->fingerprints.clear();
+    saved->has_baseline = true;
+    rebuild_saved_search_paths(saved);
+}
 
-void PrintLastError(DWORD error_code)
+// NOTE(irwin): finishes runs that are done, run_scheduler starts the ones that are due
+static void update_saved_searches()
 {
-    wchar_t *buffer;
-    DWORD format_result = FormatMessageW(
-        FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_ALLOCATE_BUFFER,
-        0,
-        error_code,
-        0,
-        (LPWSTR)&buffer,
-        0,
-        0
-    );
-    if (format_result)
+    for (Saved_Search *saved : g_SavedSearches)
     {
-        wprintf(buffer);
-        LocalFree(buffer);
+        if (saved->run)
+        {
+            fingerprint_new_rows(saved);
+            Command *command = &saved->run->command;
+            if (command->started && !is_ingest_done(command))
+            {
+                continue;
+            }
+            finish_ingest_thread(command);
+            fingerprint_new_rows(saved);
+
+            // NOTE(irwin): an incomplete run would show everything it didn't get to as removed
+            saved->last_run_failed = saved->run_failed || !command->drained || command->abort_requested || saved->fingerprinted_rows != result_store_published_row_count(&saved->run->store);
+            if (!saved->last_run_failed)
+            {
+                diff_saved_search(saved);
+            }
+            GetLocalTime(&saved->last_run_time);
+            destroy_search(saved->run);
+            saved->run = nullptr;
+            saved->fingerprints.clear();
+            saved_search_schedule_next(saved);
+        }
     }
 }
 
-void Win32OutputLastError()
+static Saved_Search *next_due_saved_search()
 {
-    PrintLastError(GetLastError());
+    long long now = get_timestamp();
+    Saved_Search *next = nullptr;
+    for (Saved_Search *saved : g_SavedSearches)
+    {
+        if (saved->enabled && !saved->run && saved->next_run_timestamp <= now && (!next || saved->next_run_timestamp < next->next_run_timestamp))
+        {
+            next = saved;
+        }
+    }
+    return next;
 }
 
+// NOTE(irwin): ones already due are waiting for a background slot, a search finishing wakes the
+// main loop for that
+static long long saved_searches_next_due_timestamp()
+{
+    long long now = get_timestamp();
+    long long due_timestamp = LLONG_MAX;
+    for (Saved_Search *saved : g_SavedSearches)
+    {
+        if (saved->enabled && !saved->run && saved->next_run_timestamp > now)
+        {
+            due_timestamp = ImMin(due_timestamp, saved->next_run_timestamp);
+        }
+    }
+    return due_timestamp;
+}
 
+// NOTE(irwin): a running search that's waiting on the user doesn't hold a background slot, it
+// would keep everything queued behind it from starting until someone looks at its tab. That's
+// rg suspended, or the ingest thread parked on the memory budget until "Load more".
+static inline bool holds_background_slot(Search *search)
+{
+    return is_search_running(search) && !search->command.suspended && !is_ingest_paused(&search->command);
+}
 
-// NOTE(irwin): caller must free
-int UTF8_ToWidechar(wchar_t **dest, const char *str, size_t str_size)
+static void run_scheduler(Search_Scheduler *scheduler, ImVector<Search_Tab *> *tabs, Search_Tab *focused_tab, HANDLE wake_event)
 {
-    int buf_char_count_needed = MultiByteToWideChar(
-        CP_UTF8,
-        0,
-        str,
-        (int)str_size,
-        0,
-        0
-    );
+    int background_running = 0;
+    int background_threads = 0;
+    for (Search_Tab *tab : *tabs)
+    {
+        if (is_search_running(tab->search))
+        {
+            set_command_foreground(&tab->search->command, tab == focused_tab);
+        }
+        if (tab != focused_tab && holds_background_slot(tab->search))
+        {
+            background_running++;
+            background_threads += tab->search->thread_count;
+        }
+        // NOTE(irwin): cached rows are already on screen, revalidating them is background work
+        // even for the focused tab
+        if (holds_background_slot(tab->revalidation))
+        {
+            background_running++;
+            background_threads += tab->revalidation->thread_count;
+        }
+    }
+    for (Saved_Search *saved : g_SavedSearches)
+    {
+        if (holds_background_slot(saved->run))
+        {
+            background_running++;
+            background_threads += saved->run->thread_count;
+        }
+    }
+
+    long long byte_budget = (long long)scheduler->memory_budget_mb * 1024 * 1024;
+    if (focused_tab && focused_tab->search_pending)
+    {
+        int thread_count = ImMax(1, scheduler->thread_budget - background_threads);
+        launch_tab_search(focused_tab, thread_count, true, byte_budget, wake_event);
+    }
 
-    if (buf_char_count_needed)
+    int background_slots = ImMax(1, scheduler->max_concurrent - 1);
+    int background_thread_count = ImMax(1, scheduler->thread_budget / 2 / background_slots);
+    // NOTE(irwin): saved searches take turns with tabs, whichever has waited longest goes first
+    while (background_running < background_slots)
     {
-        *dest = (wchar_t *)malloc((buf_char_count_needed + 1) * sizeof(wchar_t));
-        MultiByteToWideChar(
-            CP_UTF8,
-            0,
-            str,
-            (int)str_size,
-            *dest,
-            buf_char_count_needed
-        );
+        Saved_Search *next_saved = next_due_saved_search();
+        Search_Tab *next = nullptr;
+        for (Search_Tab *tab : *tabs)
+        {
+            bool pending = (tab != focused_tab && tab->search_pending) || tab->revalidation_pending;
+            if (pending && (!next || tab->requested_timestamp < next->requested_timestamp))
+            {
+                next = tab;
+            }
+        }
+        if (next_saved && (!next || next_saved->next_run_timestamp < next->requested_timestamp))
+        {
+            if (launch_saved_search(next_saved, background_thread_count, wake_event))
+            {
+                background_running++;
+            }
+            else
+            {
+                next_saved->last_run_failed = true;
+                GetLocalTime(&next_saved->last_run_time);
+                saved_search_schedule_next(next_saved);
+            }
+            continue;
+        }
+        if (!next)
+        {
+            break;
+        }
 
-        (*dest)[buf_char_count_needed] = 0;
+        if (launch_tab_search(next, background_thread_count, false, byte_budget, wake_event))
+        {
+            background_running++;
+        }
     }
+}
 
-    return buf_char_count_needed;
+// NOTE(irwin): definitions live in imgui.ini as [SavedSearch][name], baselines only in memory, the
+// first run after a start sets a new one
+static void *saved_search_settings_read_open(ImGuiContext *, ImGuiSettingsHandler *, const char *name)
+{
+    return create_saved_search(name);
 }
 
-int UTF8_ToWidechar(wchar_t **dest, const char *str)
+static void saved_search_settings_read_line(ImGuiContext *, ImGuiSettingsHandler *, void *entry, const char *line)
 {
-    size_t len = 0;
-    if (str)
+    Saved_Search *saved = (Saved_Search *)entry;
+    int value = 0;
+    if (strncmp(line, "Query=", 6) == 0)
+    {
+        ImStrncpy(saved->query, line + 6, IM_ARRAYSIZE(saved->query));
+    }
+    else if (strncmp(line, "Dir=", 4) == 0)
+    {
+        ImStrncpy(saved->dir, line + 4, IM_ARRAYSIZE(saved->dir));
+    }
+    else if (strncmp(line, "Command=", 8) == 0)
     {
-        len = strlen(str);
+        ImStrncpy(saved->search_command, line + 8, IM_ARRAYSIZE(saved->search_command));
+    }
+    else if (sscanf(line, "IgnoreCase=%d", &value) == 1)
+    {
+        saved->ignore_case = value != 0;
+    }
+    else if (sscanf(line, "Enabled=%d", &value) == 1)
+    {
+        saved->enabled = value != 0;
+    }
+    else if (sscanf(line, "IntervalMinutes=%d", &value) == 1)
+    {
+        saved->interval_minutes = ImMax(1, value);
     }
-    return UTF8_ToWidechar(dest, str, len);
 }
 
-// TODO(irwin): this parser sucks, rewrite or switch to parsing ripgrep's json output, we'll
-//              probably have to do that anyway if we want to highlight matches inline
-enum Token_Kind
+static void saved_search_settings_write_all(ImGuiContext *, ImGuiSettingsHandler *handler, ImGuiTextBuffer *out)
 {
-    Token_Kind_Invalid = 0,
-    Token_Kind_Colon,
-    Token_Kind_CR,
-    Token_Kind_LF,
-    Token_Kind_Rest,
-
-    Token_Kind_COUNT
-};
+    for (Saved_Search *saved : g_SavedSearches)
+    {
+        out->appendf("[%s][%s]\n", handler->TypeName, saved->name);
+        out->appendf("Query=%s\n", saved->query);
+        out->appendf("Dir=%s\n", saved->dir);
+        out->appendf("Command=%s\n", saved->search_command);
+        out->appendf("IgnoreCase=%d\n", (int)saved->ignore_case);
+        out->appendf("Enabled=%d\n", (int)saved->enabled);
+        out->appendf("IntervalMinutes=%d\n\n", saved->interval_minutes);
+    }
+}
 
-struct Token
+static void saved_searches_init()
 {
-    int index;
-    int ch;
-    Token_Kind previous_kind;
-    Token_Kind kind;
-    Token_Kind next_kind;
-};
+    ImGuiSettingsHandler handler;
+    handler.TypeName = "SavedSearch";
+    handler.TypeHash = ImHashStr("SavedSearch");
+    handler.ReadOpenFn = saved_search_settings_read_open;
+    handler.ReadLineFn = saved_search_settings_read_line;
+    handler.WriteAllFn = saved_search_settings_write_all;
+    ImGui::AddSettingsHandler(&handler);
+}
 
-static inline Token_Kind get_token_kind(int ch)
+static void show_saved_searches_menu(Search_Tab *focused_tab)
 {
-    // TODO(irwin): we probably want to skip non-printable characters, but I don't know
-    // if this check will fail correct utf8 characters or bytes, since atm the incoming
-    // text encoding is uncertain, so assume it's ascii for now
-    // if (ch > 0 && ch < 255)
-    if (!!true)
+    if (ImGui::MenuItem("Save this tab's search", 0, false, focused_tab != nullptr))
+    {
+        Saved_Search *saved = create_saved_search(focused_tab->query);
+        ImStrncpy(saved->query, focused_tab->query, IM_ARRAYSIZE(saved->query));
+        ImStrncpy(saved->dir, focused_tab->dir, IM_ARRAYSIZE(saved->dir));
+        ImStrncpy(saved->search_command, focused_tab->search_command, IM_ARRAYSIZE(saved->search_command));
+        saved->ignore_case = focused_tab->ignore_case;
+        ImGui::MarkIniSettingsDirty();
+    }
+    ImGui::SetItemTooltip("Reruns it in the background at idle priority and lists what changed since the run before");
+    if (g_SavedSearches.Size > 0)
+    {
+        ImGui::Separator();
+    }
+
+    for (int index = 0; index < g_SavedSearches.Size; ++index)
     {
-        switch (ch)
+        Saved_Search *saved = g_SavedSearches[index];
+        ImGui::PushID(saved);
+        char label[256];
+        if (saved->run)
+        {
+            ImFormatString(label, IM_ARRAYSIZE(label), "%s (running)###saved", saved->name);
+        }
+        else if (saved->has_baseline)
+        {
+            ImFormatString(label, IM_ARRAYSIZE(label), "%s (+%d -%d)###saved", saved->name, saved->added, saved->removed);
+        }
+        else
+        {
+            ImFormatString(label, IM_ARRAYSIZE(label), "%s###saved", saved->name);
+        }
+
+        bool removed = false;
+        if (ImGui::BeginMenu(label))
         {
-            case ':':
+            ImGui::TextDisabled("%s in %s", saved->query, saved->dir);
+            if (ImGui::Checkbox("enabled", &saved->enabled))
+            {
+                ImGui::MarkIniSettingsDirty();
+            }
+            ImGui::SameLine();
+            ImGui::SetNextItemWidth(ImGui::GetFontSize() * 6.0f);
+            if (ImGui::DragInt("every", &saved->interval_minutes, 1.0f, 1, 7 * 24 * 60, "%d min"))
+            {
+                saved_search_schedule_next(saved);
+                ImGui::MarkIniSettingsDirty();
+            }
+            if (ImGui::MenuItem("Run now", 0, false, saved->run == nullptr))
+            {
+                saved->next_run_timestamp = 0;
+                saved->enabled = true;
+            }
+            if (ImGui::MenuItem("Remove"))
             {
-                return Token_Kind_Colon;
-            } break;
+                removed = true;
+            }
+            ImGui::Separator();
 
-            case '\n':
+            if (saved->last_run_time.wYear)
+            {
+                ImGui::Text("last run %02d:%02d, %s", saved->last_run_time.wHour, saved->last_run_time.wMinute, saved->last_run_failed ? "failed or stopped early" : "complete");
+            }
+            if (saved->has_baseline)
+            {
+                ImGui::Text("%d rows, %d added, %d removed", saved->row_count, saved->added, saved->removed);
+                if (saved->added > SAVED_SEARCH_DELTA_LIST_MAX || saved->removed > SAVED_SEARCH_DELTA_LIST_MAX)
+                {
+                    ImGui::TextDisabled("only the first %d of each are listed", SAVED_SEARCH_DELTA_LIST_MAX);
+                }
+                if (!saved->delta.empty())
+                {
+                    ImGui::BeginChild("delta", ImVec2(ImGui::GetFontSize() * 40.0f, ImGui::GetFontSize() * 15.0f), ImGuiChildFlags_Border, ImGuiWindowFlags_HorizontalScrollbar);
+                    ImGui::TextUnformatted(saved->delta.begin(), saved->delta.end());
+                    ImGui::EndChild();
+                }
+            }
+            else if (!saved->run)
             {
-                return Token_Kind_LF;
-            } break;
+                ImGui::TextDisabled("not run yet, the first run is the baseline");
+            }
+            ImGui::EndMenu();
+        }
+        ImGui::PopID();
+
+        if (removed)
+        {
+            destroy_saved_search(saved);
+            ImGui::MarkIniSettingsDirty();
+            index--;
+        }
+    }
+}
+
+// NOTE(irwin): single instance. The first barerg owns a named pipe, a later `barerg query [dir]`
+// hands its query to it and exits before creating a window, the running one opens it in a new
+// tab. --new-instance skips all of it.
+struct Instance_Server
+{
+    HANDLE pipe;
+    HANDLE thread;
+    HANDLE io_event;
+    HANDLE stop_event;
+    HANDLE wake_event;
+
+    SRWLOCK lock;
+    Instance_Request requests[16];
+    int request_count;
+    // NOTE(irwin): a plain `barerg` with no query only brings the window up
+    volatile LONG activate;
+};
+
+static Instance_Server g_InstanceServer;
+
+// NOTE(irwin): "query\0dir\0", utf8. Only to a barerg of this user, another one could have
+// taken the name and would get the query while we exit without a window.
+static bool forward_to_running_instance(const Instance_Request *request)
+{
+    wchar_t name[PIPE_NAME_CAPACITY];
+    if (!get_user_pipe_name("instance", name, IM_ARRAYSIZE(name)))
+    {
+        return false;
+    }
+    HANDLE pipe = CreateFileW(name, GENERIC_WRITE, 0, 0, OPEN_EXISTING, 0, 0);
+    if (pipe == INVALID_HANDLE_VALUE && GetLastError() == ERROR_PIPE_BUSY && WaitNamedPipeW(name, 500))
+    {
+        pipe = CreateFileW(name, GENERIC_WRITE, 0, 0, OPEN_EXISTING, 0, 0);
+    }
+    if (pipe == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    if (!is_pipe_server_same_user(pipe))
+    {
+        CloseHandle(pipe);
+        return false;
+    }
+
+    // NOTE(irwin): only the process the user just started may give away the foreground
+    ULONG server_process_id = 0;
+    if (GetNamedPipeServerProcessId(pipe, &server_process_id))
+    {
+        AllowSetForegroundWindow(server_process_id);
+    }
+
+    char message[sizeof(Instance_Request)];
+    int query_size = (int)strlen(request->query) + 1;
+    int dir_size = (int)strlen(request->dir) + 1;
+    memcpy(message, request->query, (size_t)query_size);
+    memcpy(message + query_size, request->dir, (size_t)dir_size);
+    DWORD written = 0;
+    BOOL ok = WriteFile(pipe, message, (DWORD)(query_size + dir_size), &written, 0);
+    CloseHandle(pipe);
+    return ok && written == (DWORD)(query_size + dir_size);
+}
+
+// NOTE(irwin): creates the pipe before anything else, whoever gets it first is the running instance
+static bool claim_instance_pipe(Instance_Server *server)
+{
+    wchar_t name[PIPE_NAME_CAPACITY];
+    if (!get_user_pipe_name("instance", name, IM_ARRAYSIZE(name)))
+    {
+        return false;
+    }
+    HANDLE pipe = CreateNamedPipeW(name, PIPE_ACCESS_INBOUND | FILE_FLAG_FIRST_PIPE_INSTANCE | FILE_FLAG_OVERLAPPED,
+                                   PIPE_TYPE_MESSAGE | PIPE_READMODE_MESSAGE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+                                   1, 0, sizeof(Instance_Request), 0, &g_UserPipeSecurity.attributes);
+    if (pipe == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    server->pipe = pipe;
+    return true;
+}
+
+// NOTE(irwin): false if stop_event got set first, the pending io is cancelled by then
+static bool instance_server_wait(Instance_Server *server, OVERLAPPED *overlapped, DWORD *bytes)
+{
+    HANDLE wait_handles[2] = { server->io_event, server->stop_event };
+    if (WaitForMultipleObjects(IM_ARRAYSIZE(wait_handles), wait_handles, FALSE, INFINITE) != WAIT_OBJECT_0)
+    {
+        CancelIoEx(server->pipe, overlapped);
+        GetOverlappedResult(server->pipe, overlapped, bytes, TRUE);
+        return false;
+    }
+    return true;
+}
+
+static void instance_server_push(Instance_Server *server, const char *message, DWORD size)
+{
+    const char *query = message;
+    const char *query_end = (const char *)memchr(message, 0, size);
+    if (!query_end)
+    {
+        return;
+    }
+    const char *dir = query_end + 1;
+    const char *dir_end = (const char *)memchr(dir, 0, (size_t)(message + size - dir));
+    if (!dir_end)
+    {
+        return;
+    }
+
+    AcquireSRWLockExclusive(&server->lock);
+    if (!query[0])
+    {
+        InterlockedExchange(&server->activate, 1);
+    }
+    else if (server->request_count < IM_ARRAYSIZE(server->requests))
+    {
+        Instance_Request *request = server->requests + server->request_count++;
+        ImStrncpy(request->query, query, IM_ARRAYSIZE(request->query));
+        ImStrncpy(request->dir, dir, IM_ARRAYSIZE(request->dir));
+    }
+    ReleaseSRWLockExclusive(&server->lock);
+    SetEvent(server->wake_event);
+}
 
-            case '\r':
+static DWORD WINAPI instance_server_thread_proc(LPVOID parameter)
+{
+    Instance_Server *server = (Instance_Server *)parameter;
+    for (;;)
+    {
+        OVERLAPPED overlapped = {};
+        overlapped.hEvent = server->io_event;
+        DWORD bytes = 0;
+        if (!ConnectNamedPipe(server->pipe, &overlapped))
+        {
+            DWORD error = GetLastError();
+            if (error == ERROR_IO_PENDING)
+            {
+                if (!instance_server_wait(server, &overlapped, &bytes))
+                {
+                    break;
+                }
+                if (!GetOverlappedResult(server->pipe, &overlapped, &bytes, FALSE))
+                {
+                    DisconnectNamedPipe(server->pipe);
+                    continue;
+                }
+            }
+            else if (error == ERROR_NO_DATA)
+            {
+                // NOTE(irwin): the client came and went already
+                DisconnectNamedPipe(server->pipe);
+                continue;
+            }
+            else if (error != ERROR_PIPE_CONNECTED)
             {
-                return Token_Kind_CR;
-            } break;
+                Win32OutputLastError();
+                break;
+            }
+        }
 
-            default:
+        char message[sizeof(Instance_Request)];
+        overlapped = {};
+        overlapped.hEvent = server->io_event;
+        bool received = false;
+        if (ReadFile(server->pipe, message, sizeof(message), 0, &overlapped) || GetLastError() == ERROR_IO_PENDING)
+        {
+            if (!instance_server_wait(server, &overlapped, &bytes))
             {
-                return Token_Kind_Rest;
-            } break;
+                break;
+            }
+            received = GetOverlappedResult(server->pipe, &overlapped, &bytes, FALSE) != 0;
+        }
+        DisconnectNamedPipe(server->pipe);
+        if (received)
+        {
+            instance_server_push(server, message, bytes);
         }
     }
-    else
+    return 0;
+}
+
+static void start_instance_server(Instance_Server *server, HANDLE wake_event)
+{
+    if (!server->pipe)
+    {
+        return;
+    }
+    server->wake_event = wake_event;
+    server->io_event = CreateEventW(0, FALSE, FALSE, 0);
+    server->stop_event = CreateEventW(0, TRUE, FALSE, 0);
+    if (server->io_event && server->stop_event)
+    {
+        server->thread = CreateThread(0, 0, instance_server_thread_proc, server, 0, 0);
+    }
+    if (!server->thread)
     {
-        return Token_Kind_Invalid;
+        Win32OutputLastError();
     }
 }
 
-Token get_token_at_index(ImGuiTextBuffer *ripgrep_output, int index)
+static void stop_instance_server(Instance_Server *server)
 {
-    Token token = {0};
-    token.index = index;
+    if (server->thread)
+    {
+        SetEvent(server->stop_event);
+        WaitForSingleObject(server->thread, INFINITE);
+        CloseHandle(server->thread);
+    }
+    if (server->io_event)
+    {
+        CloseHandle(server->io_event);
+    }
+    if (server->stop_event)
+    {
+        CloseHandle(server->stop_event);
+    }
+    if (server->pipe)
+    {
+        CloseHandle(server->pipe);
+    }
+    *server = {};
+}
 
-    if (index < ripgrep_output->size())
+// NOTE(irwin): opens a tab per forwarded query, true if the window should come to the front
+static bool take_instance_requests(Instance_Server *server, ImVector<Search_Tab *> *tabs, Search_Tab *focused_tab)
+{
+    if (!server->thread)
     {
-        token.ch = (*ripgrep_output)[index];
-        token.kind = get_token_kind(token.ch);
-        token.previous_kind = index > 0 ? get_token_kind((*ripgrep_output)[index-1]) : Token_Kind_Invalid;
-        token.next_kind = (index + 1) < ripgrep_output->size() ? get_token_kind((*ripgrep_output)[index+1]) : Token_Kind_Invalid;
+        return false;
     }
 
-    return token;
+    AcquireSRWLockExclusive(&server->lock);
+    int request_count = server->request_count;
+    Instance_Request requests[IM_ARRAYSIZE(server->requests)];
+    memcpy(requests, server->requests, (size_t)request_count * sizeof(Instance_Request));
+    server->request_count = 0;
+    ReleaseSRWLockExclusive(&server->lock);
+
+    for (int index = 0; index < request_count; ++index)
+    {
+        // NOTE(irwin): everything else comes from the focused tab, the tab bar selects new tabs
+        Search_Tab *tab = create_search_tab(focused_tab);
+        ImStrncpy(tab->query, requests[index].query, IM_ARRAYSIZE(tab->query));
+        if (requests[index].dir[0])
+        {
+            ImStrncpy(tab->dir, requests[index].dir, IM_ARRAYSIZE(tab->dir));
+        }
+        tabs->push_back(tab);
+        request_tab_search(tab);
+    }
+    return InterlockedExchange(&server->activate, 0) != 0 || request_count > 0;
 }
 
-struct IndexedString
+// NOTE(irwin): the daemon side. A run is one rg whose stdout goes into `output`, every client that
+// asked for the same key gets it from the start, late ones catch up from memory. Finished runs are
+// kept for max_age_seconds within cache_mb, so a second window opening the same search doesn't run
+// rg again. A run nobody listens to anymore gets its rg killed.
+struct Daemon_Run
 {
-    int first;
-    int one_past_last;
+    char *key;
+    Command command;
+    HANDLE reader_thread;
+    // NOTE(irwin): only the reader thread writes, [0, size) is readable by everyone
+    Virtual_Buffer output;
+
+    // NOTE(irwin): under g_SearchDaemon.lock
+    size_t size;
+    bool done;
+    // NOTE(irwin): set with done, true if rg closed its stdout on its own and all of it is in output
+    bool drained;
+    DWORD exit_code;
+    bool cancelled;
+    int listeners;
+    long long done_timestamp;
+    long long last_used_timestamp;
+    Daemon_Run *next;
 };
 
-struct ParsedLine
+struct Search_Daemon
 {
-    IndexedString filepath;
-    IndexedString line_number;
-    IndexedString match;
+    SRWLOCK lock;
+    CONDITION_VARIABLE changed;
+    Daemon_Run *runs;
+    int cache_mb;
+    int max_age_seconds;
+
+    int requests;
+    int runs_started;
+    int joined_running;
+    int cache_hits;
 };
 
-static Token eat_all_newlines(ImGuiTextBuffer *ripgrep_output, Token at)
+static Search_Daemon g_SearchDaemon;
+
+static DWORD WINAPI daemon_reader_thread_proc(LPVOID parameter)
 {
-    while (at.kind != Token_Kind_Invalid &&
-           (at.kind == Token_Kind_CR || at.kind == Token_Kind_LF))
+    Daemon_Run *run = (Daemon_Run *)parameter;
+    bool pipe_closed = false;
+    for (;;)
     {
-        at = get_token_at_index(ripgrep_output, at.index+1);
+        size_t read_size = ImMin((size_t)INGEST_READ_SIZE, run->output.reserved - run->output.used);
+        if (read_size == 0 || !virtual_buffer_ensure(&run->output, read_size))
+        {
+            break;
+        }
+        DWORD read = 0;
+        if (!ReadFile(run->command.stdout_read, run->output.base + run->output.used, (DWORD)read_size, &read, 0))
+        {
+            pipe_closed = GetLastError() == ERROR_BROKEN_PIPE;
+            break;
+        }
+        run->output.used += read;
+
+        AcquireSRWLockExclusive(&g_SearchDaemon.lock);
+        run->size = run->output.used;
+        ReleaseSRWLockExclusive(&g_SearchDaemon.lock);
+        WakeAllConditionVariable(&g_SearchDaemon.changed);
     }
 
-    return at;
+    // NOTE(irwin): like the ingest thread, rg is only killed if it may still be blocked on the pipe,
+    // otherwise clients get the exit code it picked
+    if (!pipe_closed)
+    {
+        TerminateJobObject(run->command.job, 1);
+    }
+    WaitForSingleObject(run->command.process_information.hProcess, INFINITE);
+    DWORD exit_code = 0;
+    GetExitCodeProcess(run->command.process_information.hProcess, &exit_code);
+    close_tracked_handle(&run->command.stdout_read);
+    close_tracked_handle(&run->command.process_information.hProcess);
+    close_tracked_handle(&run->command.job);
+
+    AcquireSRWLockExclusive(&g_SearchDaemon.lock);
+    // NOTE(irwin): a cancelled run's pipe closes because its rg was killed
+    run->drained = pipe_closed && !run->cancelled;
+    run->exit_code = exit_code;
+    run->done = true;
+    run->done_timestamp = get_timestamp();
+    ReleaseSRWLockExclusive(&g_SearchDaemon.lock);
+    WakeAllConditionVariable(&g_SearchDaemon.changed);
+    return 0;
 }
 
-static Token eat_until_newlines(ImGuiTextBuffer *ripgrep_output, Token at)
+static size_t daemon_cached_bytes()
 {
-    while (at.kind != Token_Kind_Invalid &&
-           at.kind != Token_Kind_CR &&
-           at.kind != Token_Kind_LF)
+    size_t bytes = 0;
+    for (Daemon_Run *run = g_SearchDaemon.runs; run; run = run->next)
     {
-        at = get_token_at_index(ripgrep_output, at.index+1);
+        bytes += run->output.committed;
     }
-
-    return at;
+    return bytes;
 }
 
-static Token eat_until_token(ImGuiTextBuffer *ripgrep_output, int start_index, Token_Kind kind)
+// NOTE(irwin): lock held. Frees finished runs nobody listens to that are cancelled, too old, or
+// the least recently used while over the cap.
+static void daemon_evict()
 {
-    IM_ASSERT(kind >= Token_Kind_Invalid && kind < Token_Kind_COUNT);
+    long long now = get_timestamp();
+    long long max_age = (long long)g_SearchDaemon.max_age_seconds * g_TimestampFrequency;
+    size_t cap = (size_t)g_SearchDaemon.cache_mb * 1024 * 1024;
+    for (;;)
+    {
+        bool over_cap = daemon_cached_bytes() > cap;
+        Daemon_Run **victim = nullptr;
+        for (Daemon_Run **link = &g_SearchDaemon.runs; *link; link = &(*link)->next)
+        {
+            Daemon_Run *run = *link;
+            if (!run->done || run->listeners > 0)
+            {
+                continue;
+            }
+            if (run->cancelled || now - run->done_timestamp > max_age)
+            {
+                victim = link;
+                break;
+            }
+            if (over_cap && (!victim || run->last_used_timestamp < (*victim)->last_used_timestamp))
+            {
+                victim = link;
+            }
+        }
+        if (!victim)
+        {
+            return;
+        }
 
-    Token start = get_token_at_index(ripgrep_output, start_index);
-    while (start.kind != Token_Kind_Invalid && start.kind != kind)
-    {
-        start = get_token_at_index(ripgrep_output, start.index+1);
+        Daemon_Run *run = *victim;
+        *victim = run->next;
+        // NOTE(irwin): done is the reader thread's last write, it's only returning now
+        WaitForSingleObject(run->reader_thread, INFINITE);
+        close_tracked_handle(&run->reader_thread);
+        virtual_buffer_release(&run->output);
+        IM_FREE(run->key);
+        free(run);
     }
-
-    return start;
 }
 
-static IndexedString parse_filepath(ImGuiTextBuffer *ripgrep_output, Token at)
+// NOTE(irwin): lock held, g_Launcher is only used in here
+static Daemon_Run *daemon_start_run(const Daemon_Request *request, const char *key)
 {
-    Token start = eat_all_newlines(ripgrep_output, at);
-    Token last = eat_until_token(ripgrep_output, start.index, Token_Kind_Colon);
-    if (last.kind == Token_Kind_Colon && last.index - start.index == 1)
+    Daemon_Run *run = (Daemon_Run *)calloc(1, sizeof(Daemon_Run));
+    if (!run)
     {
-        last = eat_until_token(ripgrep_output, last.index+1, Token_Kind_Colon);
+        return nullptr;
     }
-
-    // IM_ASSERT(start.index < last.index);
-
-    IndexedString filepath = {0};
-    filepath.first = start.index;
-    filepath.one_past_last = last.index;
-
-    return filepath;
-}
-
-static IndexedString parse_line_num(ImGuiTextBuffer *ripgrep_output, Token at)
-{
-    Token start = eat_all_newlines(ripgrep_output, at);
-    start = eat_until_token(ripgrep_output, start.index, Token_Kind_Colon);
-    Token last = {0};
-    if (start.kind == Token_Kind_Colon)
+    launcher_begin_search_command(request->search_command, request->ignore_case != 0, (Output_Format)request->output_format, request->row_fields,
+                                  request->query, ImMax(1, request->thread_count), false);
+    launcher_append_argument(&g_Launcher, request->dir);
+    wchar_t *command_line = launcher_finish(&g_Launcher);
+    run->command.foreground = true;
+    if (!command_line || !virtual_buffer_reserve(&run->output, RESULT_STORE_TEXT_RESERVE) || !spawn_command(&g_Launcher, &run->command, command_line))
     {
-        last = eat_until_token(ripgrep_output, start.index+1, Token_Kind_Colon);
+        virtual_buffer_release(&run->output);
+        free(run);
+        return nullptr;
     }
-
-    IndexedString line_number = {0};
-    line_number.first = start.index+1;
-    line_number.one_past_last = last.index;
-
-    return line_number;
+    run->reader_thread = CreateThread(0, 0, daemon_reader_thread_proc, run, 0, 0);
+    if (!run->reader_thread)
+    {
+        Win32OutputLastError();
+        TerminateJobObject(run->command.job, 1);
+        WaitForSingleObject(run->command.process_information.hProcess, INFINITE);
+        close_tracked_handle(&run->command.stdout_read);
+        close_tracked_handle(&run->command.process_information.hProcess);
+        close_tracked_handle(&run->command.job);
+        virtual_buffer_release(&run->output);
+        free(run);
+        return nullptr;
+    }
+    track_handle_opened(run->reader_thread);
+    run->key = ImStrdup(key);
+    run->next = g_SearchDaemon.runs;
+    g_SearchDaemon.runs = run;
+    g_SearchDaemon.runs_started++;
+    return run;
 }
 
-static IndexedString parse_match(ImGuiTextBuffer *ripgrep_output, Token at)
+static bool read_exactly(HANDLE pipe, void *data, DWORD size)
 {
-    Token start = get_token_at_index(ripgrep_output, at.index+1);
-    Token last = eat_until_newlines(ripgrep_output, start);
-
-    // IM_ASSERT(start.index < last.index);
-
-    IndexedString match = {0};
-    match.first = start.index;
-    match.one_past_last = last.index;
-
-    return match;
+    DWORD total = 0;
+    while (total < size)
+    {
+        DWORD read = 0;
+        if (!ReadFile(pipe, (char *)data + total, size - total, &read, 0) || read == 0)
+        {
+            return false;
+        }
+        total += read;
+    }
+    return true;
 }
 
-#if 0
-#else
+// NOTE(irwin): how often a client thread waiting for rg checks whether its client hung up. The
+// client never writes after the request, so that only shows on the pipe.
+static const DWORD DAEMON_HANGUP_CHECK_MS = 250;
 
-static int parse_rg_stdout(ImGuiTextBuffer *ripgrep_output, ImVector<ParsedLine> *lines)
+// NOTE(irwin): one thread per client, it sends the run's output from the start and follows it
+// until rg is done or the client hangs up
+static DWORD WINAPI daemon_client_thread_proc(LPVOID parameter)
 {
-    int first_index = 0;
-    int lines_count_before = lines->size();
-    if (lines_count_before > 0)
+    HANDLE pipe = (HANDLE)parameter;
+    Daemon_Request request;
+    if (!read_exactly(pipe, &request, sizeof(request)) || request.version != DAEMON_PROTOCOL_VERSION ||
+        request.output_format < 0 || request.output_format >= Output_Format_COUNT)
     {
-        // NOTE(irwin): one_past_last is at LF
-        first_index = lines->back().match.one_past_last;
+        CloseHandle(pipe);
+        return 0;
     }
-
-    for (int char_index = first_index; char_index < ripgrep_output->size();)
+    request.search_command[IM_ARRAYSIZE(request.search_command) - 1] = 0;
+    request.query[IM_ARRAYSIZE(request.query) - 1] = 0;
+    request.dir[IM_ARRAYSIZE(request.dir) - 1] = 0;
+
+    char key[IM_ARRAYSIZE(request.search_command) + IM_ARRAYSIZE(request.query) + IM_ARRAYSIZE(request.dir) + 32];
+    build_daemon_key(&request, key, IM_ARRAYSIZE(key));
+
+    AcquireSRWLockExclusive(&g_SearchDaemon.lock);
+    g_SearchDaemon.requests++;
+    daemon_evict();
+    Daemon_Run *run = nullptr;
+    for (Daemon_Run *candidate = g_SearchDaemon.runs; candidate; candidate = candidate->next)
     {
-        Token token = get_token_at_index(ripgrep_output, char_index);
-
-        IndexedString filepath = parse_filepath(ripgrep_output, token);
-        token = get_token_at_index(ripgrep_output, filepath.one_past_last);
-        if (token.kind == Token_Kind_Colon)
+        if (!candidate->cancelled && (!candidate->done || !request.fresh) && strcmp(candidate->key, key) == 0)
         {
-            IndexedString line_number = parse_line_num(ripgrep_output, token);
-            token = get_token_at_index(ripgrep_output, line_number.one_past_last);
-            if (token.kind == Token_Kind_Colon)
+            run = candidate;
+            if (run->done)
             {
-                IndexedString match = parse_match(ripgrep_output, token);
-                token = get_token_at_index(ripgrep_output, match.one_past_last);
-
-                if (token.kind == Token_Kind_CR || token.kind == Token_Kind_LF)
-                {
-                    if (filepath.first < filepath.one_past_last &&
-                        line_number.first < line_number.one_past_last &&
-                        match.first < match.one_past_last)
-                    {
-                        ParsedLine new_line = {0};
-                        new_line.filepath = filepath;
-                        new_line.line_number = line_number;
-                        new_line.match = match;
-                        lines->push_back(new_line);
-
-                        char_index = new_line.match.one_past_last;
-                    }
-                    else
-                    {
-                        break;
-                    }
-                }
-                else
-                {
-                    break;
-                }
+                g_SearchDaemon.cache_hits++;
             }
             else
             {
+                g_SearchDaemon.joined_running++;
+            }
+            break;
+        }
+    }
+    if (!run)
+    {
+        run = daemon_start_run(&request, key);
+    }
+    if (run)
+    {
+        run->listeners++;
+        run->last_used_timestamp = get_timestamp();
+    }
+    ReleaseSRWLockExclusive(&g_SearchDaemon.lock);
+    fprintf(stderr, "%s %s in %s\n", run ? "search" : "failed", request.query, request.dir);
+    if (!run)
+    {
+        CloseHandle(pipe);
+        return 0;
+    }
+
+    size_t sent = 0;
+    bool client_gone = false;
+    bool drained = false;
+    DWORD exit_code = 0;
+    for (;;)
+    {
+        AcquireSRWLockExclusive(&g_SearchDaemon.lock);
+        if (sent == run->size && !run->done)
+        {
+            SleepConditionVariableSRW(&g_SearchDaemon.changed, &g_SearchDaemon.lock, DAEMON_HANGUP_CHECK_MS, 0);
+        }
+        size_t size = run->size;
+        const char *output = run->output.base;
+        bool done = run->done;
+        drained = run->drained;
+        exit_code = run->exit_code;
+        ReleaseSRWLockExclusive(&g_SearchDaemon.lock);
+
+        if (sent == size)
+        {
+            if (done)
+            {
+                break;
+            }
+            // NOTE(irwin): fails with ERROR_BROKEN_PIPE once the client closed its end
+            if (!PeekNamedPipe(pipe, 0, 0, 0, 0, 0))
+            {
+                client_gone = true;
                 break;
             }
+            continue;
         }
-        else
+        // NOTE(irwin): blocks while the client's budget keeps it from reading, rg doesn't wait on that
+        DWORD chunk = (DWORD)ImMin(size - sent, (size_t)INGEST_READ_SIZE);
+        DWORD written = 0;
+        if (!WriteFile(pipe, output + sent, chunk, &written, 0))
         {
+            client_gone = true;
             break;
         }
+        sent += written;
+    }
+    if (!client_gone && drained)
+    {
+        char trailer[DAEMON_TRAILER_SIZE + 1];
+        ImFormatString(trailer, IM_ARRAYSIZE(trailer), "%s%08x", DAEMON_TRAILER_PREFIX, (unsigned)exit_code);
+        DWORD written = 0;
+        client_gone = !WriteFile(pipe, trailer, (DWORD)DAEMON_TRAILER_SIZE, &written, 0);
+    }
+    if (!client_gone)
+    {
+        FlushFileBuffers(pipe);
     }
+    CloseHandle(pipe);
 
-    return lines->size() - lines_count_before;
+    AcquireSRWLockExclusive(&g_SearchDaemon.lock);
+    run->listeners--;
+    if (run->listeners == 0 && !run->done)
+    {
+        run->cancelled = true;
+        TerminateJobObject(run->command.job, 1);
+    }
+    daemon_evict();
+    ReleaseSRWLockExclusive(&g_SearchDaemon.lock);
+    return 0;
 }
-#endif
 
-void kill_running_command(Command *command)
+// NOTE(irwin): `barerg --daemon`, runs until it's killed. Logs to the console it was started from.
+static int run_search_daemon(Command_Line_Options *options)
 {
-    TerminateProcess(command->process_information.hProcess, 0);
-    command->started = false;
-    *command = {0};
+    attach_parent_console();
+
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    g_TimestampFrequency = frequency.QuadPart;
+    if (!launcher_init(&g_Launcher))
+    {
+        return 2;
+    }
+    nt_api_init(&g_NtApi);
+    virtual_buffer_api_init(&g_VirtualBufferApi);
+    g_SearchDaemon.cache_mb = options->daemon_cache_mb;
+    g_SearchDaemon.max_age_seconds = options->daemon_max_age_seconds;
+
+    wchar_t name[PIPE_NAME_CAPACITY];
+    if (!get_user_pipe_name("daemon", name, IM_ARRAYSIZE(name)))
+    {
+        fprintf(stderr, "barerg: couldn't get this user's SID for the daemon pipe\n");
+        return 2;
+    }
+    for (bool first = true;; first = false)
+    {
+        DWORD open_mode = PIPE_ACCESS_DUPLEX | (first ? FILE_FLAG_FIRST_PIPE_INSTANCE : 0);
+        HANDLE pipe = CreateNamedPipeW(name, open_mode, PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+                                       PIPE_UNLIMITED_INSTANCES, INGEST_PIPE_SIZE, sizeof(Daemon_Request), 0, &g_UserPipeSecurity.attributes);
+        if (pipe == INVALID_HANDLE_VALUE)
+        {
+            if (first)
+            {
+                fprintf(stderr, "barerg: a search daemon is already running in this session\n");
+                return 1;
+            }
+            Win32OutputLastError();
+            Sleep(100);
+            continue;
+        }
+        if (first)
+        {
+            fprintf(stderr, "barerg: search daemon listening, cache %d MB for %d s\n", g_SearchDaemon.cache_mb, g_SearchDaemon.max_age_seconds);
+        }
+
+        if (!ConnectNamedPipe(pipe, 0) && GetLastError() != ERROR_PIPE_CONNECTED)
+        {
+            CloseHandle(pipe);
+            continue;
+        }
+        HANDLE thread = CreateThread(0, 0, daemon_client_thread_proc, pipe, 0, 0);
+        if (thread)
+        {
+            CloseHandle(thread);
+        }
+        else
+        {
+            CloseHandle(pipe);
+        }
+    }
 }
 
 // Main code
 int main(int, char**)
 {
+    // NOTE(irwin): before the window and d3d, forwarding a query to a running barerg is the fast path
+    Command_Line_Options options;
+    bool options_valid = parse_command_line(&options);
+    user_pipe_security_init(&g_UserPipeSecurity);
+    if (options.stress_output_gb > 0)
+    {
+        return write_stress_output(&options);
+    }
+    if (options.headless)
+    {
+        return run_headless(&options, options_valid);
+    }
+    if (options.daemon)
+    {
+        return run_search_daemon(&options);
+    }
+    Instance_Request *startup_request = &options.request;
+    if (!options.new_instance && !claim_instance_pipe(&g_InstanceServer) && forward_to_running_instance(startup_request))
+    {
+        return 0;
+    }
+
     // Create application window
     //ImGui_ImplWin32_EnableDpiAwareness();
     WNDCLASSEXW wc = { sizeof(wc), CS_CLASSDC, WndProc, 0L, 0L, GetModuleHandle(nullptr), nullptr, nullptr, nullptr, nullptr, L"barerg", nullptr };
@@ -389,6 +3369,7 @@ int main(int, char**)
     IMGUI_CHECKVERSION();
     ImGui::CreateContext();
     ImGuiIO& io = ImGui::GetIO(); (void)io;
+    saved_searches_init();
     io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard;     // Enable Keyboard Controls
     io.ConfigFlags |= ImGuiConfigFlags_NavEnableGamepad;      // Enable Gamepad Controls
     io.ConfigFlags |= ImGuiConfigFlags_DockingEnable;         // Enable Docking
@@ -440,22 +3421,96 @@ int main(int, char**)
     // Our state
     ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
 
-    // TODO(irwin): move main logic into its own file to decouple from d3d11 backend
-    Command command = {0};
-    static ImGuiTextBuffer ripgrep_output;
-    static ImVector<ParsedLine> ripgrep_output_lines;
+    ImVector<Search_Tab *> tabs;
+    tabs.push_back(create_search_tab(nullptr));
+    Search_Tab *focused_tab = tabs[0];
+
+    static Search_Scheduler scheduler;
+    scheduler_init(&scheduler);
+    search_cache_init(&g_SearchCache);
 
     float smoothed_framerate = io.Framerate;
 
     LARGE_INTEGER frequency;
     QueryPerformanceFrequency(&frequency);
+    g_TimestampFrequency = frequency.QuadPart;
+
+    if (!launcher_init(&g_Launcher))
+    {
+        return 1;
+    }
+    nt_api_init(&g_NtApi);
+    virtual_buffer_api_init(&g_VirtualBufferApi);
+    if (startup_request->query[0])
+    {
+        ImStrncpy(tabs[0]->query, startup_request->query, IM_ARRAYSIZE(tabs[0]->query));
+        ImStrncpy(tabs[0]->dir, startup_request->dir, IM_ARRAYSIZE(tabs[0]->dir));
+        request_tab_search(tabs[0]);
+    }
 
-    long long next_search_schedule_when_typing = LLONG_MAX;
+    // NOTE(irwin): the main loop sleeps until a window message, published rows or a timeout, and
+    // only renders then. frames_to_render > 0 means don't sleep yet: after any input imgui needs a
+    // couple of frames to settle hover/focus state. idle_timeout_ms is set by each rendered frame
+    // for things that change on their own, like a blinking cursor or a tooltip about to appear.
+    HANDLE main_loop_wake_event = CreateEventW(0, FALSE, FALSE, 0);
+    start_instance_server(&g_InstanceServer, main_loop_wake_event);
+    int frames_to_render = 3;
+    DWORD idle_timeout_ms = INFINITE;
 
     // Main loop
     bool done = false;
     while (!done)
     {
+        if (frames_to_render == 0)
+        {
+            DWORD timeout_ms = idle_timeout_ms;
+            long long current_timestamp = get_timestamp();
+            for (Search_Tab *tab : tabs)
+            {
+                if (tab->next_search_schedule_when_typing != LLONG_MAX)
+                {
+                    long long ticks_left = tab->next_search_schedule_when_typing - current_timestamp;
+                    DWORD search_timeout_ms = ticks_left > 0 ? (DWORD)(ticks_left * 1000 / frequency.QuadPart) + 1 : 0;
+                    timeout_ms = ImMin(timeout_ms, search_timeout_ms);
+                }
+                if (tab->watcher && can_patch_tab_search(tab))
+                {
+                    long long due_timestamp = live_patch_due_timestamp(tab);
+                    if (due_timestamp != LLONG_MAX)
+                    {
+                        long long ticks_left = due_timestamp - current_timestamp;
+                        DWORD patch_timeout_ms = ticks_left > 0 ? (DWORD)(ticks_left * 1000 / frequency.QuadPart) + 1 : 0;
+                        timeout_ms = ImMin(timeout_ms, patch_timeout_ms);
+                    }
+                }
+            }
+            long long saved_due_timestamp = saved_searches_next_due_timestamp();
+            if (saved_due_timestamp != LLONG_MAX)
+            {
+                long long ticks_left = saved_due_timestamp - current_timestamp;
+                DWORD saved_timeout_ms = ticks_left > 0 ? (DWORD)ImMin(ticks_left * 1000 / frequency.QuadPart + 1, (long long)INFINITE - 1) : 0;
+                timeout_ms = ImMin(timeout_ms, saved_timeout_ms);
+            }
+
+            // NOTE(irwin): an ingest thread handle is signaled once its rg exited and the pipe is drained
+            HANDLE wait_handles[MAXIMUM_WAIT_OBJECTS - 1];
+            DWORD wait_handle_count = 0;
+            wait_handles[wait_handle_count++] = main_loop_wake_event;
+            for (Search_Tab *tab : tabs)
+            {
+                if (wait_handle_count < IM_ARRAYSIZE(wait_handles) && tab->search && tab->search->command.ingest_thread)
+                {
+                    wait_handles[wait_handle_count++] = tab->search->command.ingest_thread;
+                }
+                if (wait_handle_count < IM_ARRAYSIZE(wait_handles) && tab->revalidation && tab->revalidation->command.ingest_thread)
+                {
+                    wait_handles[wait_handle_count++] = tab->revalidation->command.ingest_thread;
+                }
+            }
+            ::MsgWaitForMultipleObjectsEx(wait_handle_count, wait_handles, timeout_ms, QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+            frames_to_render = 1;
+        }
+
         // Poll and handle messages (inputs, window resize, etc.)
         // See the WndProc() function below for our to dispatch events to the Win32 backend.
         MSG msg;
@@ -465,14 +3520,18 @@ int main(int, char**)
             ::DispatchMessage(&msg);
             if (msg.message == WM_QUIT)
                 done = true;
+            frames_to_render = 3;
         }
         if (done)
             break;
 
+        update_search_priorities(&scheduler, &tabs, focused_tab);
+
         // Handle window being minimized or screen locked
         if (g_SwapChainOccluded && g_pSwapChain->Present(0, DXGI_PRESENT_TEST) == DXGI_STATUS_OCCLUDED)
         {
-            ::Sleep(10);
+            // NOTE(irwin): nothing to draw into, wake up for messages or to test Present again
+            ::MsgWaitForMultipleObjectsEx(0, nullptr, 100, QS_ALLINPUT, MWMO_INPUTAVAILABLE);
             continue;
         }
         g_SwapChainOccluded = false;
@@ -490,47 +3549,34 @@ int main(int, char**)
         ImGui_ImplDX11_NewFrame();
         ImGui_ImplWin32_NewFrame();
 
-        static bool was_active = false;
-
-        static int activeFrames = 3;
-        if( command.started || was_active )
-        {
-            activeFrames = 3;
-        }
-        else
+        reap_retired_searches(false);
+        for (Search_Tab *tab : tabs)
         {
-            auto ctx = ImGui::GetCurrentContext();
-            if( ctx->NavWindowingTarget || ( ctx->DimBgRatio != 0 && ctx->DimBgRatio != 1 ) )
+            if (tab->search && tab->search->command.started && is_ingest_done(&tab->search->command))
             {
-                activeFrames = 3;
+                finish_ingest_thread(&tab->search->command);
             }
-            else
+            if (tab->revalidation && tab->revalidation->command.started && is_ingest_done(&tab->revalidation->command))
             {
-                auto& inputQueue = ctx->InputEventsQueue;
-                if( !inputQueue.empty() )
-                {
-                    for( auto& v : inputQueue )
-                    {
-                        if( v.Type != ImGuiInputEventType_MouseViewport )
-                        {
-                            activeFrames = 3;
-                            break;
-                        }
-                    }
-                }
+                finish_ingest_thread(&tab->revalidation->command);
             }
+            update_tab_revalidation(tab);
+            update_tab_narrowing(tab);
+            update_tab_live(tab, main_loop_wake_event);
         }
-        if( activeFrames == 0 )
+        update_saved_searches();
+        if (take_instance_requests(&g_InstanceServer, &tabs, focused_tab))
         {
-            // std::this_thread::sleep_for( std::chrono::milliseconds( 16 ) );
-            ::Sleep(16);
-            continue;
+            if (::IsIconic(hwnd))
+            {
+                ::ShowWindow(hwnd, SW_RESTORE);
+            }
+            ::SetForegroundWindow(hwnd);
+            frames_to_render = 3;
         }
-        activeFrames--;
-        was_active = false;
-
-
 
+        frames_to_render--;
+        bool tooltip_pending = false;
 
         ImGui::NewFrame();
 
@@ -547,272 +3593,125 @@ int main(int, char**)
             ImGui::Begin("Hello, world!", NULL, ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_MenuBar);
 
             ImGui::BeginMenuBar();
-            ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / smoothed_framerate, smoothed_framerate);
-            ImGui::EndMenuBar();
-
+            if (ImGui::BeginMenu("Settings"))
             {
-                if (ImGui::GetIO().KeyCtrl && ImGui::IsKeyPressed(ImGuiKey_F) && !ImGui::IsAnyItemActive())
-                {
-                    ImGui::SetKeyboardFocusHere();
-                }
-                static char ripgrep_query[1024] = "imgui";
-                bool run_pressed = false;
-                if(ImGui::InputText("ripgrep_query", ripgrep_query, IM_ARRAYSIZE(ripgrep_query)))
-                {
-                    LARGE_INTEGER current_timestamp;
-                    QueryPerformanceCounter(&current_timestamp);
-
-                    next_search_schedule_when_typing = current_timestamp.QuadPart + (frequency.QuadPart >> 2);
-                }
-                else
-                {
-                    // run_pressed |= ImGui::IsItemDeactivatedAfterEdit();
-                }
-                was_active |= ImGui::IsItemActive();
-
-                static char ripgrep_dir[1024] = "c:\\proj\\cpp";
-                ImGui::InputText("ripgrep_dir", ripgrep_dir, IM_ARRAYSIZE(ripgrep_dir));
-                was_active |= ImGui::IsItemActive();
-                run_pressed |= ImGui::IsItemDeactivatedAfterEdit();
-
-                // TODO(irwin): when we have separate input field for search term, restart search if time since last input
-                //              change is greater than ~20-100 ms
-                static bool ignore_case = false;
-                run_pressed |= ImGui::Checkbox("ignore_case", &ignore_case);
-                ImGui::SameLine();
-
-                static char ripgrep_search_command[1024] = "rg.exe --line-number";
-                ImGui::InputText("ripgrep_search_command", ripgrep_search_command, IM_ARRAYSIZE(ripgrep_search_command));
-                was_active |= ImGui::IsItemActive();
-                run_pressed |= ImGui::IsItemDeactivatedAfterEdit();
-
-                run_pressed |= ImGui::Button("Run ripgrep");
-                ImGui::SameLine();
-                ImGui::BeginDisabled(!command.started);
-                if(ImGui::Button("Stop"))
+                ImGui::SetNextItemWidth(ImGui::GetFontSize() * 8.0f);
+                ImGui::SliderInt("max concurrent rg", &scheduler.max_concurrent, 1, 16);
+                ImGui::SetNextItemWidth(ImGui::GetFontSize() * 8.0f);
+                ImGui::SliderInt("rg thread budget", &scheduler.thread_budget, 1, 256);
+                ImGui::SetNextItemWidth(ImGui::GetFontSize() * 8.0f);
+                ImGui::DragInt("memory per search", &scheduler.memory_budget_mb, 16.0f, 0, 1 << 20, scheduler.memory_budget_mb ? "%d MB" : "unlimited");
+                ImGui::SetItemTooltip("Stop reading rg output past this size until the results are scrolled near the end");
+                ImGui::SetNextItemWidth(ImGui::GetFontSize() * 8.0f);
+                ImGui::DragInt("suspend rg past", &scheduler.suspend_rows_ahead, 1000.0f, 0, INT_MAX, scheduler.suspend_rows_ahead ? "%d rows" : "never");
+                ImGui::SetItemTooltip("Suspend rg once it's this many rows past what the table shows, it continues when you scroll down.\n"
+                                      "rg also drops to low priority while barerg isn't the active app, and is suspended while it's minimized.");
+                ImGui::Checkbox("use search daemon", &g_SearchDaemonClient.enabled);
+                ImGui::SetItemTooltip("Send searches to `barerg --daemon` when it's running, identical searches from several windows share one rg.\n"
+                                      "Falls back to running rg here when there's no daemon. rg's priority and suspension are the daemon's business then.");
+                ImGui::Separator();
+                ImGui::SetNextItemWidth(ImGui::GetFontSize() * 8.0f);
+                if (ImGui::DragInt("search cache", &g_SearchCache.memory_cap_mb, 16.0f, 0, 1 << 20, g_SearchCache.memory_cap_mb ? "%d MB" : "off"))
                 {
-                    kill_running_command(&command);
+                    search_cache_evict(&g_SearchCache, (long long)g_SearchCache.memory_cap_mb * 1024 * 1024);
                 }
-                ImGui::EndDisabled();
-
-
-                ImGui::SameLine();
-                ImGui::Text("%d matches", ripgrep_output_lines.size());
-
-                // TODO(irwin): extract start/kill helpers
-
-                LARGE_INTEGER current_timestamp;
-                QueryPerformanceCounter(&current_timestamp);
-                if (run_pressed || current_timestamp.QuadPart >= next_search_schedule_when_typing)
+                ImGui::SetItemTooltip("Completed searches are kept up to this size, going back to one shows it without running rg");
                 {
-                    next_search_schedule_when_typing = LLONG_MAX;
-                    if (command.started)
-                    {
-                        kill_running_command(&command);
-                    }
-                    ripgrep_output.clear();
-                    ripgrep_output_lines.clear();
-
-                    SECURITY_ATTRIBUTES saAttr;
-                    saAttr.nLength = sizeof(SECURITY_ATTRIBUTES);
-                    saAttr.bInheritHandle = TRUE;
-                    saAttr.lpSecurityDescriptor = NULL;
-
-                    if (!CreatePipe(&command.stdout_read, &command.stdout_write, &saAttr, 0))
-                    {
-                        Win32OutputLastError();
-                    }
-                    else
+                    static const char *revalidate_names[Cache_Revalidate_COUNT] = { "never", "if dir changed", "always" };
+                    int revalidate = g_SearchCache.revalidate;
+                    ImGui::SetNextItemWidth(ImGui::GetFontSize() * 8.0f);
+                    if (ImGui::Combo("revalidate cached", &revalidate, revalidate_names, Cache_Revalidate_COUNT))
                     {
-                        if (!SetHandleInformation(command.stdout_read, HANDLE_FLAG_INHERIT, 0))
-                        {
-                            Win32OutputLastError();
-                        }
-                        else
-                        {
-                            STARTUPINFOW si = { sizeof(si) };
-                            si.hStdOutput = command.stdout_write;
-                            si.dwFlags |= STARTF_USESTDHANDLES;
-
-                            command.process_information = {};
-
-                            // const char command_string[] = "rg.exe imgui c:\\proj\\cpp";
-                            // const char command_string[] = "cmd /c echo hello";
-                            const char working_dir[] = "c:\\proj\\cpp";
-
-                            ImGuiTextBuffer command_builder;
-                            command_builder.append(ripgrep_search_command);
-                            if (ignore_case)
-                            {
-                                command_builder.append(" -i");
-                            }
-                            command_builder.appendf(" %s", ripgrep_query);
-                            command_builder.appendf(" %s", ripgrep_dir);
-
-                            wchar_t *command_string_wide = 0;
-                            UTF8_ToWidechar(&command_string_wide, command_builder.c_str());
-
-                            if (command_string_wide)
-                            {
-                                wchar_t *working_dir_wide = 0;
-                                UTF8_ToWidechar(&working_dir_wide, working_dir);
-                                if (CreateProcessW(0, command_string_wide, 0, 0, true, CREATE_NO_WINDOW, 0, 0, &si, &command.process_information) != 0)
-                                {
-                                    command.started = true;
-                                    CloseHandle(command.stdout_write);
-                                }
-                                else
-                                {
-                                    // TODO(irwin): we need to remove broken command if we don't want it to be retried ad infinitum
-                                    // TODO(irwin): run CompleteExecutingCommand ?
-                                    CloseHandle(command.stdout_read);
-                                    CloseHandle(command.stdout_write);
-                                }
-                                if (working_dir_wide)
-                                {
-                                    free(working_dir_wide);
-                                }
-                                free(command_string_wide);
-                            }
-
-                        }
-
-
+                        g_SearchCache.revalidate = (Cache_Revalidate)revalidate;
                     }
-
+                    ImGui::SetItemTooltip("Rerun rg in the background when a cached search is shown, and swap in the fresh rows when it's done.\n"
+                                          "\"if dir changed\" checks the last write time of ripgrep_dir itself, which only changes when\n"
+                                          "entries directly in it are added, removed or renamed.");
                 }
-                // if (!ripgrep_output_lines.empty())
+                ImGui::EndMenu();
+            }
+            if (ImGui::BeginMenu("Saved searches"))
+            {
+                show_saved_searches_menu(focused_tab);
+                ImGui::EndMenu();
+            }
+            if (ImGui::BeginMenu("Stats"))
+            {
+                DWORD process_handle_count = 0;
+                GetProcessHandleCount(GetCurrentProcess(), &process_handle_count);
+
+                ImGui::Text("rg spawned: %d (failed %d)", (int)g_ProcessCounters.spawned, (int)g_ProcessCounters.spawn_failed);
+                ImGui::Text("rg running: %d", (int)g_ProcessCounters.running);
+                ImGui::Text("rg cancelled: %d", (int)g_ProcessCounters.cancelled);
+                ImGui::Text("rg reaped: %d", (int)g_ProcessCounters.reaped);
+                ImGui::Text("rg suspended: %d", (int)g_ProcessCounters.suspended);
+                ImGui::Text("retired searches draining: %d", g_RetiredSearchCount);
+                ImGui::Text("sent to search daemon: %d (unreachable %d)", (int)g_SearchDaemonClient.sent, (int)g_SearchDaemonClient.unreachable);
+                ImGui::Text("search cache: %d entries, %.1f MB, %d hits, %d misses", g_SearchCache.entry_count, (double)g_SearchCache.memory_used / (1024.0 * 1024.0), g_SearchCache.hits, g_SearchCache.misses);
+                ImGui::Separator();
+                ImGui::Text("handles held for rg runs: %d", (int)g_ProcessCounters.open_handles);
+                ImGui::Text("process handle count: %u", (unsigned)process_handle_count);
+                ImGui::Separator();
+                ImGui::PushID("spawn");
+                show_launch_stats_history("spawn", g_LaunchStats.spawn_ms, g_LaunchStats.spawn_count);
+                ImGui::PopID();
+                ImGui::PushID("first_byte");
+                show_launch_stats_history("spawn to first byte", g_LaunchStats.first_byte_ms, g_LaunchStats.first_byte_count);
+                ImGui::PopID();
+                ImGui::Separator();
                 {
-                    // if (ImGui::BeginChild("ripgrep output"))
+                    // NOTE(irwin): only on a finished search, the ingest thread owns the store until then
+                    Search *search = focused_tab ? focused_tab->search : nullptr;
+                    bool can_benchmark = search && !is_search_running(search) && can_benchmark_parsers(&search->store);
+                    if (ImGui::MenuItem("Benchmark parsers on this tab's output", 0, false, can_benchmark))
                     {
-                        static ImGuiTableFlags flags = ImGuiTableFlags_ScrollY | ImGuiTableFlags_ScrollX | ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersOuter | ImGuiTableFlags_BordersV | ImGuiTableFlags_Resizable | ImGuiTableFlags_Reorderable | ImGuiTableFlags_Hideable;
-
-                        // PushStyleCompact();
-                        // ImGui::CheckboxFlags("ImGuiTableFlags_ScrollY", &flags, ImGuiTableFlags_ScrollY);
-                        // PopStyleCompact();
-
-                        // const float TEXT_BASE_WIDTH = ImGui::CalcTextSize("A").x;
-                        // const float TEXT_BASE_HEIGHT = ImGui::GetTextLineHeightWithSpacing();
-                        // IM_UNUSED(TEXT_BASE_WIDTH);
-
-
-                        // When using ScrollX or ScrollY we need to specify a size for our table container!
-                        // Otherwise by default the table will fit all available space, like a BeginChild() call.
-                        ImVec2 outer_size = ImVec2(0.0f, 0.0f);
-                        if (ImGui::BeginTable("ripgrep_table", 4, flags, outer_size))
-                        {
-                            ImGui::TableSetupScrollFreeze(0, 1); // Make top row always visible
-                            ImGui::TableSetupColumn("#", ImGuiTableColumnFlags_None);
-                            ImGui::TableSetupColumn("Path", ImGuiTableColumnFlags_None);
-                            ImGui::TableSetupColumn("Line", ImGuiTableColumnFlags_None);
-                            ImGui::TableSetupColumn("Match", ImGuiTableColumnFlags_None);
-                            // ImGui::TableSetupColumn("Three", ImGuiTableColumnFlags_None);
-                            ImGui::TableHeadersRow();
-
-                            // if (ripgrep_output_lines.empty())
-                            // {
-                            //     ImGui::TableNextRow();
-                            // }
-
-                            // Demonstrate using clipper for large vertical lists
-                            ImGuiListClipper clipper;
-                            clipper.Begin(ripgrep_output_lines.size());
-                            while (clipper.Step())
-                            {
-                                for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++)
-                                {
-                                    ParsedLine line = ripgrep_output_lines[row];
-                                    ImGui::TableNextRow();
-#if 0
-#else
+                        run_parser_benchmark(&search->store, &g_ParserBenchmark);
+                    }
+                    ImGui::SetItemTooltip("Needs a finished search with output set to null and spill to disk off");
+                    show_parser_benchmark(&g_ParserBenchmark);
+                }
+                ImGui::EndMenu();
+            }
+            ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / smoothed_framerate, smoothed_framerate);
+            ImGui::EndMenuBar();
 
-                                    ImGui::TableSetColumnIndex(0);
-                                    ImGui::Text("%d", row+1);
-
-                                    bool pressed = false;
-                                    ImGui::TableSetColumnIndex(1);
-                                    {
-                                        ImGuiTextBuffer filepath;
-                                        filepath.append(ripgrep_output.begin() + line.filepath.first, ripgrep_output.begin() + line.filepath.one_past_last);
-                                        ImGui::PushID(row);
-                                        pressed = ImGui::Selectable(filepath.c_str(), false, ImGuiSelectableFlags_SpanAllColumns | ImGuiSelectableFlags_AllowItemOverlap);
-                                        if (ImGui::BeginPopupContextItem())
-                                        {
-                                            if (ImGui::MenuItem("Copy row"))
-                                            {
-                                                ImGuiTextBuffer to_copy;
-                                                to_copy.append(ripgrep_output.begin() + line.filepath.first, ripgrep_output.begin() + line.filepath.one_past_last);
-                                                to_copy.appendf("%s", ":");
-                                                to_copy.append(ripgrep_output.begin() + line.line_number.first, ripgrep_output.begin() + line.line_number.one_past_last);
-                                                to_copy.appendf("%s", ":");
-                                                to_copy.append(ripgrep_output.begin() + line.match.first, ripgrep_output.begin() + line.match.one_past_last);
-                                                ImGui::SetClipboardText(to_copy.c_str());
-                                            }
-                                            ImGui::EndPopup();
-                                        }
-                                        ImGui::PopID();
-                                    }
-
-                                    ImGui::TableSetColumnIndex(2);
-                                    {
-                                        const char *line_first = ripgrep_output.begin() + line.line_number.first;
-                                        const char *line_one_past_last = ripgrep_output.begin() + line.line_number.one_past_last;
-                                        // ImGui::SetNextItemWidth(-ImGui::CalcTextSize(line_first, line_one_past_last).x);
-                                        ImGui::SetCursorPosX(ImGui::GetCursorPosX() + (ImGui::GetContentRegionAvail().x - ImGui::CalcTextSize(line_first, line_one_past_last).x) - 3.0f);
-
-                                        ImGuiTextBuffer buf;
-                                        buf.append(line_first, line_one_past_last);
-                                        // ImGui::SetNextItemWidth(-ImGui::GetContentRegionAvail().x);
-                                        // ImGui::SetNextItemWidth(-FLT_MIN);
-                                        // ImGui::SetNextItemWidth(-100.0f);
-                                        ImGui::Text(buf.c_str());
-
-                                        if (pressed)
-                                        {
-                                            buf.clear();
-                                            buf.append("C:\\Program Files (x86)\\Notepad++\\notepad++.exe");
-
-                                            ImGuiTextBuffer buf2;
-                                            buf2.appendf("\"%.*s\"", line.filepath.one_past_last - line.filepath.first, ripgrep_output.begin() + line.filepath.first);
-                                            buf2.appendf(" -n%.*s", line.line_number.one_past_last - line.line_number.first, ripgrep_output.begin() + line.line_number.first);
-
-                                            ShellExecuteA(NULL, "open", buf.c_str(), buf2.c_str(), NULL, 0);
-                                        }
-                                    }
-#endif
+            show_search_tabs(&tabs, &focused_tab, &tooltip_pending);
+            run_scheduler(&scheduler, &tabs, focused_tab, main_loop_wake_event);
 
-                                    // ImGui::TextUnformatted(line_first, line_one_past_last);
-                                    // ImGui::Text("%.*s", line_one_past_last - line_first, line_first);
+            ImGui::End();
+        }
 
+        idle_timeout_ms = INFINITE;
+        {
+            ImGuiContext *ctx = ImGui::GetCurrentContext();
+            if (ctx->NavWindowingTarget || (ctx->DimBgRatio != 0 && ctx->DimBgRatio != 1))
+            {
+                frames_to_render = ImMax(frames_to_render, 1);
+            }
 
-                                    ImGui::TableSetColumnIndex(3);
-                                    ImGui::TextUnformatted(ripgrep_output.begin() + line.match.first, ripgrep_output.begin() + line.match.one_past_last);
-                                    if (ImGui::BeginItemTooltip())
-                                    {
-                                        ImGui::PushTextWrapPos(ImGui::GetFontSize() * 35.0f);
-                                        ImGui::TextUnformatted(ripgrep_output.begin() + line.match.first, ripgrep_output.begin() + line.match.one_past_last);
-                                        ImGui::PopTextWrapPos();
-                                        ImGui::EndTooltip();
-                                    }
-                                    else if (ImGui::IsItemHovered())
-                                    {
-                                        was_active |= true;
-                                    }
+            if (tooltip_pending)
+            {
+                // NOTE(irwin): hover delays are timed with io.DeltaTime, a frame after the stationary delay moves them along
+                idle_timeout_ms = ImMin(idle_timeout_ms, (DWORD)(ImGui::GetStyle().HoverStationaryDelay * 1000.0f) + 1);
+            }
 
-                                }
-                            }
-                            ImGui::EndTable();
-                        }
-                    }
-                    // ImGui::EndChild();
+            ImGuiInputTextState *input_state = &ctx->InputTextState;
+            if (io.ConfigInputTextCursorBlink && input_state->ID != 0 && input_state->ID == ctx->ActiveId)
+            {
+                // NOTE(irwin): cursor is visible while anim <= 0 or fmod(anim, 1.2) <= 0.8, see InputTextEx()
+                float anim = input_state->CursorAnim;
+                float until_toggle = 0.0f;
+                if (anim <= 0.0f)
+                {
+                    until_toggle = -anim + 0.80f;
                 }
-                // else
+                else
                 {
-                    // ImGui::Text("Ripgrep output empty");
+                    float phase = ImFmod(anim, 1.20f);
+                    until_toggle = (phase <= 0.80f ? 0.80f : 1.20f) - phase;
                 }
+                idle_timeout_ms = ImMin(idle_timeout_ms, (DWORD)(until_toggle * 1000.0f) + 1);
             }
-
-            ImGui::End();
         }
 
         // Rendering
@@ -829,60 +3728,39 @@ int main(int, char**)
             ImGui::RenderPlatformWindowsDefault();
         }
 
-        if (command.started)
-        {
-            bool first_bytes_arrived = !ripgrep_output.empty();
-            if (!first_bytes_arrived)
-            {
-                DWORD bytes_available = 0;
-                BOOL peek_success = PeekNamedPipe(
-                    command.stdout_read,      //HANDLE  hNamedPipe,
-                    NULL,             //LPVOID  lpBuffer,
-                    0,                //DWORD   nBufferSize,
-                    NULL,             //LPDWORD lpBytesRead,
-                    &bytes_available, //LPDWORD lpTotalBytesAvail,
-                    NULL              //LPDWORD lpBytesLeftThisMessage
-                );
-                IM_UNUSED(peek_success);
-
-                first_bytes_arrived = bytes_available > 0;
-            }
-
-            // NOTE(irwin): prevent ReadFile ui lag on process creation
-            if (first_bytes_arrived)
-            {
-                DWORD read;
-                const int BUFSIZE = 8192;
-                char chBuf[BUFSIZE] = {};
-
-                if (ReadFile(command.stdout_read, chBuf, BUFSIZE, &read, NULL))
-                {
-                    ripgrep_output.append(&chBuf[0], &chBuf[0] + read);
-                    int lines_parsed = parse_rg_stdout(&ripgrep_output, &ripgrep_output_lines);
-                    IM_UNUSED(lines_parsed);
-                }
-                else
-                {
-                    command.started = false;
-                    CloseHandle(command.stdout_read);
-                    {
-                    }
-                }
-            }
-
-        }
-
-
         // Present
         HRESULT hr = g_pSwapChain->Present(1, 0);   // Present with vsync
         //HRESULT hr = g_pSwapChain->Present(0, 0); // Present without vsync
         g_SwapChainOccluded = (hr == DXGI_STATUS_OCCLUDED);
     }
 
+    stop_instance_server(&g_InstanceServer);
+    for (Search_Tab *tab : tabs)
+    {
+        destroy_search_tab(tab);
+    }
+    tabs.clear();
+    // NOTE(irwin): the definitions stay until imgui has written them to the ini
+    for (Saved_Search *saved : g_SavedSearches)
+    {
+        if (saved->run)
+        {
+            retire_search(saved->run);
+            saved->run = nullptr;
+        }
+    }
+    search_cache_clear(&g_SearchCache);
+    reap_retired_searches(true);
+    CloseHandle(main_loop_wake_event);
+
     // Cleanup
     ImGui_ImplDX11_Shutdown();
     ImGui_ImplWin32_Shutdown();
     ImGui::DestroyContext();
+    while (g_SavedSearches.Size > 0)
+    {
+        destroy_saved_search(g_SavedSearches.back());
+    }
 
     CleanupDeviceD3D();
     ::DestroyWindow(hwnd);
@@ -966,6 +3844,7 @@ LRESULT WINAPI WndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam)
     switch (msg)
     {
     case WM_SIZE:
+        g_WindowMinimized = (wParam == SIZE_MINIMIZED);
         if (wParam == SIZE_MINIMIZED)
             return 0;
         g_ResizeWidth = (UINT)LOWORD(lParam); // Queue resize
@@ -975,6 +3854,9 @@ LRESULT WINAPI WndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam)
         if ((wParam & 0xfff0) == SC_KEYMENU) // Disable ALT application menu
             return 0;
         break;
+    case WM_ACTIVATEAPP:
+        g_WindowActive = (wParam != 0);
+        break;
     case WM_DESTROY:
         ::PostQuitMessage(0);
         return 0;
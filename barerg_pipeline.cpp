@@ -0,0 +1,3822 @@
+// NOTE(irwin): the search pipeline, everything `barerg --headless` runs: the launcher, the ingest
+// thread, the parsers and the result store. No window, d3d or ImGui context in here, only imgui's
+// containers and string helpers. barerg.cpp includes it, there's no separate translation unit.
+
+#include "imgui.h"
+#include "imgui_internal.h"
+#include <windows.h>
+#include <wchar.h> // wprintf
+#include <emmintrin.h> // SSE2, always there on x64
+#if defined(__AVX2__)
+#include <immintrin.h> // only with /arch:AVX2
+#endif
+#include <psapi.h> // GetProcessMemoryInfo
+#include <stdio.h> // headless output
+
+// TODO(irwin): remove @cleanup
+enum Pipe_State
+{
+    PipeState_Invalid = 0,
+    // PipeState_RetryingToOpen,
+    PipeState_Open,
+
+    PipeState_COUNT
+};
+
+
+struct Result_Store;
+
+struct Command
+{
+    bool started;
+    bool abort_requested;
+    HANDLE stdout_read;
+    HANDLE stdout_write;
+    PROCESS_INFORMATION process_information;
+    Pipe_State pipe_state;
+    // NOTE(irwin): rg and anything it spawns (--pre), terminating or closing it kills the whole tree
+    HANDLE job;
+    DWORD exit_code;
+    // NOTE(irwin): written by the ingest thread before ingest_done, true if it read until rg closed
+    // the pipe, i.e. the store holds all of rg's output
+    bool drained;
+    // NOTE(irwin): stdout_read is a pipe to the search daemon, there's no process or job of ours
+    bool remote;
+
+    // NOTE(irwin): focused tab's rg runs at normal priority, background ones below normal.
+    // throttled drops it to idle cpu and very low io priority, suspended stops its threads.
+    bool foreground;
+    bool throttled;
+    bool suspended;
+
+    // NOTE(irwin): QueryPerformanceCounter ticks, first_byte_timestamp is written by the ingest thread
+    long long spawn_timestamp;
+    long long spawned_timestamp;
+    volatile long long first_byte_timestamp;
+
+    // NOTE(irwin): drains stdout_read into the store, independent of the frame rate
+    Result_Store *store;
+    HANDLE ingest_thread;
+    volatile LONG ingest_done;
+    // NOTE(irwin): auto-reset event owned by the main loop, set whenever new rows get published
+    HANDLE wake_event;
+
+    // NOTE(irwin): backpressure. Once the store grows past byte_budget the ingest thread stops
+    // reading and waits on resume_event, rg then blocks on the full pipe by itself.
+    HANDLE resume_event;
+    volatile LONGLONG byte_budget;
+    volatile LONG ingest_paused;
+    volatile LONG abort_signaled;
+};
+
+
+void PrintLastError(DWORD error_code)
+{
+    wchar_t *buffer;
+    DWORD format_result = FormatMessageW(
+        FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_ALLOCATE_BUFFER,
+        0,
+        error_code,
+        0,
+        (LPWSTR)&buffer,
+        0,
+        0
+    );
+    if (format_result)
+    {
+        wprintf(buffer);
+        LocalFree(buffer);
+    }
+}
+
+void Win32OutputLastError()
+{
+    PrintLastError(GetLastError());
+}
+
+
+
+// NOTE(irwin): caller must free
+int UTF8_ToWidechar(wchar_t **dest, const char *str, size_t str_size)
+{
+    int buf_char_count_needed = MultiByteToWideChar(
+        CP_UTF8,
+        0,
+        str,
+        (int)str_size,
+        0,
+        0
+    );
+
+    if (buf_char_count_needed)
+    {
+        *dest = (wchar_t *)malloc((buf_char_count_needed + 1) * sizeof(wchar_t));
+        MultiByteToWideChar(
+            CP_UTF8,
+            0,
+            str,
+            (int)str_size,
+            *dest,
+            buf_char_count_needed
+        );
+
+        (*dest)[buf_char_count_needed] = 0;
+    }
+
+    return buf_char_count_needed;
+}
+
+int UTF8_ToWidechar(wchar_t **dest, const char *str)
+{
+    size_t len = 0;
+    if (str)
+    {
+        len = strlen(str);
+    }
+    return UTF8_ToWidechar(dest, str, len);
+}
+
+// NOTE(irwin): a span of a store's text. 64-bit, a search over generated logs can print more than
+// 2 GB.
+struct IndexedString
+{
+    long long first;
+    long long one_past_last;
+};
+
+// NOTE(irwin): a span inside one row's json message, relative to the row's match.first
+struct Row_Span
+{
+    int first;
+    int one_past_last;
+};
+
+// NOTE(irwin): json is --json output, null is --null, the path ends at a NUL instead of a colon,
+// heading is --heading, the path is printed once on its own line above the file's matches
+enum Output_Format
+{
+    Output_Format_Text = 0,
+    Output_Format_Json,
+    Output_Format_Null,
+    Output_Format_Heading,
+
+    Output_Format_COUNT
+};
+
+// NOTE(irwin): numbers rg is asked to print after the line number, --column and --byte-offset.
+// rg prints them in this order.
+enum Row_Field_Flags
+{
+    Row_Field_Column = 1 << 0,
+    Row_Field_Byte_Offset = 1 << 1,
+};
+
+struct ParsedLine
+{
+    IndexedString match;
+
+    // NOTE(irwin): parsed at ingest. line_number is 0 when rg didn't print one (json without -n),
+    // column is 1-based and 0 when unknown, absolute_offset is -1 when unknown.
+    long long absolute_offset;
+    int line_number;
+    int column;
+
+    // NOTE(irwin): in the store's path table, see result_store_path
+    ImU32 path_id;
+
+    // NOTE(irwin): json only. submatches is a packed Row_Span[] in the text, it and the spans in it
+    // are relative to match.first, see parse_json_submatches
+    Row_Span submatches;
+};
+
+// NOTE(irwin): every handle we open for an rg run goes through here, so leaks show up in the
+// counters instead of in Task Manager after an hour of typing
+struct Process_Counters
+{
+    volatile LONG spawned;
+    volatile LONG spawn_failed;
+    volatile LONG running;
+    volatile LONG cancelled;
+    volatile LONG reaped;
+    volatile LONG open_handles;
+    volatile LONG suspended;
+};
+
+static Process_Counters g_ProcessCounters;
+
+static inline void track_handle_opened(HANDLE handle)
+{
+    if (handle)
+    {
+        InterlockedIncrement(&g_ProcessCounters.open_handles);
+    }
+}
+
+static inline void close_tracked_handle(HANDLE *handle)
+{
+    if (*handle)
+    {
+        CloseHandle(*handle);
+        *handle = 0;
+        InterlockedDecrement(&g_ProcessCounters.open_handles);
+    }
+}
+
+// NOTE(irwin): append-only memory whose bytes never move. Pages are committed as the buffer
+// grows and so is the address space, up to `reserved`. Each time it runs out the buffer gets
+// another pagefile-backed section as large as all of the earlier ones together, and all of them
+// are mapped again, side by side, at a new base. The earlier mappings stay where they are and show
+// the same pages, so a pointer some other thread got from an older base stays valid until release
+// while the ingest thread keeps appending; base itself is only for whoever grows the buffer and
+// whoever it publishes to. Without the placeholder api (before Windows 10 1803) the whole range
+// is reserved up front like it used to be.
+static const int VIRTUAL_BUFFER_MAX_SECTIONS = 16;
+static const size_t VIRTUAL_BUFFER_COMMIT_GRANULARITY = 1024 * 1024;
+static const size_t VIRTUAL_BUFFER_FIRST_SECTION_SIZE = 16 * 1024 * 1024;
+
+struct Virtual_Buffer
+{
+    char *base;
+    size_t reserved;
+    size_t mapped;
+    size_t committed;
+    size_t used;
+
+    // NOTE(irwin): section_bases[i] is where sections 0..i are mapped, base is the last of them
+    int section_count;
+    HANDLE sections[VIRTUAL_BUFFER_MAX_SECTIONS];
+    size_t section_sizes[VIRTUAL_BUFFER_MAX_SECTIONS];
+    char *section_bases[VIRTUAL_BUFFER_MAX_SECTIONS];
+};
+
+// NOTE(irwin): kernelbase exports, looked up once at startup by virtual_buffer_api_init
+typedef void *(WINAPI *Virtual_Alloc_2)(HANDLE process, void *address, SIZE_T size, ULONG allocation_type, ULONG protection,
+                                        void *extended_parameters, ULONG parameter_count);
+typedef void *(WINAPI *Map_View_Of_File_3)(HANDLE section, HANDLE process, void *address, ULONG64 offset, SIZE_T size, ULONG allocation_type,
+                                           ULONG protection, void *extended_parameters, ULONG parameter_count);
+
+struct Virtual_Buffer_Api
+{
+    Virtual_Alloc_2 virtual_alloc_2;
+    Map_View_Of_File_3 map_view_of_file_3;
+};
+
+static Virtual_Buffer_Api g_VirtualBufferApi;
+
+// NOTE(irwin): MEM_RESERVE_PLACEHOLDER, MEM_REPLACE_PLACEHOLDER and MEM_PRESERVE_PLACEHOLDER,
+// older SDKs don't have them
+static const ULONG VIRTUAL_BUFFER_RESERVE_PLACEHOLDER = 0x00040000;
+static const ULONG VIRTUAL_BUFFER_REPLACE_PLACEHOLDER = 0x00004000;
+static const ULONG VIRTUAL_BUFFER_PRESERVE_PLACEHOLDER = 0x00000002;
+
+static void virtual_buffer_api_init(Virtual_Buffer_Api *api)
+{
+    HMODULE kernelbase = GetModuleHandleW(L"kernelbase.dll");
+    if (kernelbase)
+    {
+        api->virtual_alloc_2 = (Virtual_Alloc_2)(void *)GetProcAddress(kernelbase, "VirtualAlloc2");
+        api->map_view_of_file_3 = (Map_View_Of_File_3)(void *)GetProcAddress(kernelbase, "MapViewOfFile3");
+    }
+    if (!api->virtual_alloc_2 || !api->map_view_of_file_3)
+    {
+        *api = {};
+    }
+}
+
+// NOTE(irwin): maps sections 0..section_count-1 back to back at a new base, which becomes the
+// buffer's. False and nothing changed if any step fails.
+static bool virtual_buffer_map_sections(Virtual_Buffer *buffer, int section_count, size_t mapped)
+{
+    HANDLE process = GetCurrentProcess();
+    char *base = (char *)g_VirtualBufferApi.virtual_alloc_2(process, 0, mapped, MEM_RESERVE | VIRTUAL_BUFFER_RESERVE_PLACEHOLDER, PAGE_NOACCESS, 0, 0);
+    if (!base)
+    {
+        Win32OutputLastError();
+        return false;
+    }
+
+    // NOTE(irwin): a view has to replace a placeholder of exactly its size, split them first.
+    // After that every piece is a placeholder of its own.
+    size_t offset = 0;
+    for (int section = 0; section + 1 < section_count; ++section)
+    {
+        VirtualFree(base + offset, buffer->section_sizes[section], MEM_RELEASE | VIRTUAL_BUFFER_PRESERVE_PLACEHOLDER);
+        offset += buffer->section_sizes[section];
+    }
+
+    offset = 0;
+    int mapped_count = 0;
+    for (; mapped_count < section_count; ++mapped_count)
+    {
+        if (!g_VirtualBufferApi.map_view_of_file_3(buffer->sections[mapped_count], process, base + offset, 0, buffer->section_sizes[mapped_count],
+                                                   VIRTUAL_BUFFER_REPLACE_PLACEHOLDER, PAGE_READWRITE, 0, 0))
+        {
+            Win32OutputLastError();
+            break;
+        }
+        offset += buffer->section_sizes[mapped_count];
+    }
+    if (mapped_count < section_count)
+    {
+        offset = 0;
+        for (int section = 0; section < section_count; ++section)
+        {
+            if (section < mapped_count)
+            {
+                UnmapViewOfFile(base + offset);
+            }
+            else
+            {
+                VirtualFree(base + offset, 0, MEM_RELEASE);
+            }
+            offset += buffer->section_sizes[section];
+        }
+        return false;
+    }
+
+    buffer->section_bases[section_count - 1] = base;
+    buffer->base = base;
+    buffer->mapped = mapped;
+    return true;
+}
+
+// NOTE(irwin): at least `needed` bytes of address space at base, doubling what's there
+static bool virtual_buffer_grow(Virtual_Buffer *buffer, size_t needed)
+{
+    if (!g_VirtualBufferApi.virtual_alloc_2 || buffer->section_count == VIRTUAL_BUFFER_MAX_SECTIONS)
+    {
+        return false;
+    }
+
+    size_t mapped = buffer->mapped ? buffer->mapped * 2 : VIRTUAL_BUFFER_FIRST_SECTION_SIZE;
+    while (mapped < needed)
+    {
+        mapped *= 2;
+    }
+    mapped = ImMin(mapped, buffer->reserved);
+    size_t section_size = mapped - buffer->mapped;
+    HANDLE section = CreateFileMappingW(INVALID_HANDLE_VALUE, 0, PAGE_READWRITE | SEC_RESERVE, (DWORD)((ULONG64)section_size >> 32), (DWORD)section_size, 0);
+    if (!section)
+    {
+        Win32OutputLastError();
+        return false;
+    }
+    track_handle_opened(section);
+
+    int section_index = buffer->section_count;
+    buffer->sections[section_index] = section;
+    buffer->section_sizes[section_index] = section_size;
+    if (!virtual_buffer_map_sections(buffer, section_index + 1, mapped))
+    {
+        close_tracked_handle(&buffer->sections[section_index]);
+        return false;
+    }
+    buffer->section_count = section_index + 1;
+    return true;
+}
+
+static bool virtual_buffer_reserve(Virtual_Buffer *buffer, size_t reserve_size)
+{
+    IM_ASSERT(buffer->base == 0);
+    IM_ASSERT((reserve_size % VIRTUAL_BUFFER_COMMIT_GRANULARITY) == 0);
+
+    *buffer = {};
+    buffer->reserved = reserve_size;
+    if (g_VirtualBufferApi.virtual_alloc_2)
+    {
+        return virtual_buffer_grow(buffer, 0);
+    }
+
+    buffer->base = (char *)VirtualAlloc(0, reserve_size, MEM_RESERVE, PAGE_READWRITE);
+    if (!buffer->base)
+    {
+        Win32OutputLastError();
+        return false;
+    }
+    buffer->mapped = reserve_size;
+    return true;
+}
+
+static void virtual_buffer_release(Virtual_Buffer *buffer)
+{
+    if (buffer->section_count)
+    {
+        for (int generation = 0; generation < buffer->section_count; ++generation)
+        {
+            size_t offset = 0;
+            for (int section = 0; section <= generation; ++section)
+            {
+                UnmapViewOfFile(buffer->section_bases[generation] + offset);
+                offset += buffer->section_sizes[section];
+            }
+        }
+        for (int section = 0; section < buffer->section_count; ++section)
+        {
+            close_tracked_handle(&buffer->sections[section]);
+        }
+    }
+    else if (buffer->base)
+    {
+        VirtualFree(buffer->base, 0, MEM_RELEASE);
+    }
+    *buffer = {};
+}
+
+// NOTE(irwin): commits enough pages for `size` more bytes past `used`, base may change. A commit
+// can't span two views, so it's done a section at a time.
+static bool virtual_buffer_ensure(Virtual_Buffer *buffer, size_t size)
+{
+    size_t needed = buffer->used + size;
+    if (needed > buffer->reserved)
+    {
+        return false;
+    }
+
+    if (needed > buffer->committed)
+    {
+        size_t new_committed = (needed + VIRTUAL_BUFFER_COMMIT_GRANULARITY - 1) & ~(VIRTUAL_BUFFER_COMMIT_GRANULARITY - 1);
+        if (new_committed > buffer->mapped && !virtual_buffer_grow(buffer, new_committed))
+        {
+            return false;
+        }
+
+        size_t section_first = 0;
+        for (int section = 0; section < ImMax(buffer->section_count, 1); ++section)
+        {
+            size_t section_end = buffer->section_count ? section_first + buffer->section_sizes[section] : buffer->mapped;
+            size_t commit_first = ImMax(buffer->committed, section_first);
+            size_t commit_end = ImMin(new_committed, section_end);
+            if (commit_first < commit_end && !VirtualAlloc(buffer->base + commit_first, commit_end - commit_first, MEM_COMMIT, PAGE_READWRITE))
+            {
+                Win32OutputLastError();
+                return false;
+            }
+            section_first = section_end;
+        }
+        buffer->committed = new_committed;
+    }
+
+    return true;
+}
+
+// NOTE(irwin): every distinct path once, NUL-terminated, under a 32-bit id. Directories get ids
+// too, a directory's name is the front of the first path interned under it, so they cost no
+// bytes of their own. One thread interns; names and entries never move once written, so another
+// thread can read any id it was handed after the id was interned. For a result store the row
+// count publish is what orders that.
+static const ImU32 PATH_ID_NONE = 0xffffffffu;
+static const size_t PATH_TABLE_NAMES_RESERVE = 512ull * 1024 * 1024;
+static const size_t PATH_TABLE_ENTRIES_RESERVE = 512ull * 1024 * 1024;
+
+struct Path_Entry
+{
+    int name_first;
+    int name_size;
+    ImU32 hash;
+    // NOTE(irwin): the directory it's in, PATH_ID_NONE if the name has no separator
+    ImU32 dir_id;
+    bool is_dir;
+    // NOTE(irwin): rows with this path, for a directory rows with a path anywhere under it. Only
+    // the interning thread writes it and the ui shows whatever it last saw.
+    volatile LONG row_count;
+};
+
+struct Path_Table
+{
+    Virtual_Buffer names;
+    Virtual_Buffer entries; // Path_Entry[]
+    int entry_count;
+
+    // NOTE(irwin): interning thread only. Open addressing with linear probing, slots hold id + 1
+    // and 0 is empty.
+    ImU32 *slots;
+    int slot_count;
+};
+
+static void path_table_release(Path_Table *table)
+{
+    virtual_buffer_release(&table->names);
+    virtual_buffer_release(&table->entries);
+    free(table->slots);
+    *table = {};
+}
+
+static inline Path_Entry *path_table_entry(Path_Table *table, ImU32 id)
+{
+    return (Path_Entry *)table->entries.base + id;
+}
+
+// NOTE(irwin): NUL-terminated for paths, a directory's name is only name_size long
+static inline const char *path_table_get(Path_Table *table, ImU32 id)
+{
+    return table->names.base + path_table_entry(table, id)->name_first;
+}
+
+static inline int path_table_size(Path_Table *table, ImU32 id)
+{
+    return path_table_entry(table, id)->name_size;
+}
+
+static bool path_table_grow(Path_Table *table)
+{
+    int slot_count = ImMax(1024, table->slot_count * 2);
+    ImU32 *slots = (ImU32 *)calloc((size_t)slot_count, sizeof(ImU32));
+    if (!slots)
+    {
+        return false;
+    }
+    for (int id = 0; id < table->entry_count; ++id)
+    {
+        int slot = (int)(path_table_entry(table, (ImU32)id)->hash & (ImU32)(slot_count - 1));
+        while (slots[slot])
+        {
+            slot = (slot + 1) & (slot_count - 1);
+        }
+        slots[slot] = (ImU32)id + 1;
+    }
+    free(table->slots);
+    table->slots = slots;
+    table->slot_count = slot_count;
+    return true;
+}
+
+static inline int find_last_path_separator(const char *name, int size)
+{
+    for (int at = size - 1; at >= 0; --at)
+    {
+        if (name[at] == '\\' || name[at] == '/')
+        {
+            return at;
+        }
+    }
+    return -1;
+}
+
+// NOTE(irwin): a directory's name points into the name of the path it was found in, which is
+// already in names when this runs
+static ImU32 path_table_insert(Path_Table *table, const char *name, int name_size, bool is_dir)
+{
+    if ((table->entry_count + 1) * 2 > table->slot_count && !path_table_grow(table))
+    {
+        return PATH_ID_NONE;
+    }
+
+    ImU32 hash = ImHashData(name, (size_t)name_size, is_dir ? 1 : 0);
+    int mask = table->slot_count - 1;
+    int slot = (int)(hash & (ImU32)mask);
+    while (table->slots[slot])
+    {
+        ImU32 id = table->slots[slot] - 1;
+        Path_Entry *existing = path_table_entry(table, id);
+        if (existing->hash == hash && existing->name_size == name_size && existing->is_dir == is_dir &&
+            memcmp(table->names.base + existing->name_first, name, (size_t)name_size) == 0)
+        {
+            return id;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    if (!virtual_buffer_ensure(&table->entries, sizeof(Path_Entry)))
+    {
+        return PATH_ID_NONE;
+    }
+    Path_Entry entry = {};
+    entry.name_size = name_size;
+    entry.hash = hash;
+    entry.is_dir = is_dir;
+    entry.dir_id = PATH_ID_NONE;
+    if (is_dir)
+    {
+        entry.name_first = (int)(name - table->names.base);
+    }
+    else
+    {
+        if (!virtual_buffer_ensure(&table->names, (size_t)name_size + 1))
+        {
+            return PATH_ID_NONE;
+        }
+        entry.name_first = (int)table->names.used;
+        memcpy(table->names.base + table->names.used, name, (size_t)name_size);
+        table->names.base[table->names.used + (size_t)name_size] = 0;
+        table->names.used += (size_t)name_size + 1;
+    }
+
+    int separator = find_last_path_separator(table->names.base + entry.name_first, name_size);
+    if (separator > 0)
+    {
+        entry.dir_id = path_table_insert(table, table->names.base + entry.name_first, separator, true);
+    }
+
+    // NOTE(irwin): the dir above may have grown the slots, look for a free one again
+    mask = table->slot_count - 1;
+    slot = (int)(hash & (ImU32)mask);
+    while (table->slots[slot])
+    {
+        slot = (slot + 1) & mask;
+    }
+    ImU32 id = (ImU32)table->entry_count;
+    *path_table_entry(table, id) = entry;
+    table->entries.used += sizeof(Path_Entry);
+    table->entry_count++;
+    table->slots[slot] = id + 1;
+    return id;
+}
+
+// NOTE(irwin): PATH_ID_NONE if the table is full
+static ImU32 path_table_intern(Path_Table *table, const char *path, int path_size)
+{
+    if (!table->names.base && (!virtual_buffer_reserve(&table->names, PATH_TABLE_NAMES_RESERVE) ||
+                               !virtual_buffer_reserve(&table->entries, PATH_TABLE_ENTRIES_RESERVE)))
+    {
+        path_table_release(table);
+        return PATH_ID_NONE;
+    }
+    return path_table_insert(table, path, path_size, false);
+}
+
+// NOTE(irwin): `count` more rows with path `id`, for it and every directory above it
+static void path_table_add_rows(Path_Table *table, ImU32 id, LONG count)
+{
+    for (; id != PATH_ID_NONE; id = path_table_entry(table, id)->dir_id)
+    {
+        path_table_entry(table, id)->row_count += count;
+    }
+}
+
+// NOTE(irwin): an upper bound, address space is taken as output arrives and the byte budget
+// usually stops a search long before this. In spill mode it only ever holds the unparsed tail.
+static const size_t RESULT_STORE_TEXT_RESERVE = 64ull * 1024 * 1024 * 1024;
+// NOTE(irwin): row indices are int everywhere, a store stops taking rows at RESULT_STORE_MAX_ROWS.
+// The shortest row rg can print is 5 bytes ("a:1:\n", an empty match), so that's reached after
+// about 10 GB of output at the earliest.
+static const size_t SHORTEST_ROW_SIZE = 5;
+static const int RESULT_STORE_MAX_ROWS = INT_MAX;
+static const size_t RESULT_STORE_ROWS_RESERVE = (size_t)RESULT_STORE_MAX_ROWS * sizeof(ParsedLine) / VIRTUAL_BUFFER_COMMIT_GRANULARITY * VIRTUAL_BUFFER_COMMIT_GRANULARITY + VIRTUAL_BUFFER_COMMIT_GRANULARITY;
+
+// NOTE(irwin): a read-only view into a spill file, remapped when a request falls outside of it.
+// Ui thread only.
+struct Spill_Window
+{
+    HANDLE mapping;
+    long long mapping_size;
+    const char *view;
+    long long view_offset;
+    long long view_size;
+};
+
+// NOTE(irwin): views have to start on the allocation granularity, which is 64k everywhere
+static const long long SPILL_VIEW_ALIGNMENT = 64 * 1024;
+static const long long SPILL_VIEW_MIN_SIZE = 16 * 1024 * 1024;
+
+// NOTE(irwin): text format, the line starting at parse_cursor as far as it's been scanned
+struct Text_Line_State
+{
+    long long line_start;
+    int colon_count;
+    long long first_colon;
+    long long match_colon;
+};
+
+// NOTE(irwin): everything a single search produces. The ingest thread is the only writer. The ui
+// only reads rows below published_row_count, and every byte those rows point at was written
+// before the count was published, so neither side takes a lock. The ui takes text.base and
+// rows.base after reading the count, a base from before that may not reach the newest rows.
+//
+// In spill mode text and rows only hold what hasn't been written out yet. The raw output and
+// the rows go to two delete-on-close temp files and the ui maps back just the rows it shows,
+// so memory stays flat no matter how many rows there are.
+struct Result_Store
+{
+    Virtual_Buffer text; // raw rg stdout
+    Virtual_Buffer rows; // ParsedLine[]
+    // NOTE(irwin): the path of every row, a file with 2000 matches is in here once. Ids below
+    // published_path_count are safe for the ui, like rows.
+    Path_Table paths;
+    volatile LONG published_path_count;
+    // NOTE(irwin): ingest thread only, the path of the last row, rg prints a file's matches
+    // together so this mostly saves hashing the path again
+    ImU32 last_path_id;
+    // NOTE(irwin): parallel parser chunks only, they can't intern into a table another thread
+    // owns. Rows get the path's span in the text here instead, one per row, and are interned when
+    // they're spliced into the real store.
+    bool defer_paths;
+    Virtual_Buffer path_spans; // IndexedString[]
+
+    // NOTE(irwin): ingest thread only. Bytes between parse_cursor and scan_cursor belong to a line
+    // whose LF hasn't arrived yet and have already been looked at, the next read picks up at
+    // scan_cursor so a line spanning many reads is still scanned once. text_line is what the
+    // text parser found in them.
+    long long parse_cursor;
+    long long scan_cursor;
+    Text_Line_State text_line;
+    int parsed_row_count;
+
+    volatile LONG published_row_count;
+
+    // NOTE(irwin): ingest thread only, everything read from rg and the ticks spent parsing it
+    long long bytes_read;
+    long long parse_ticks;
+
+    Output_Format format;
+    // NOTE(irwin): Row_Field_Flags, what rg prints between the line number and the match
+    int row_fields;
+    // NOTE(irwin): ingest thread only, heading format. The path line of the file block being
+    // parsed, every row in the block gets it.
+    bool heading_in_block;
+    ImU32 heading_path_id;
+
+    bool spill;
+    HANDLE text_file;
+    HANDLE rows_file;
+    // NOTE(irwin): ingest thread only, where text.base[0] is in text_file
+    long long text_file_base;
+    Spill_Window text_window;
+    Spill_Window rows_window;
+};
+
+static HANDLE create_spill_file()
+{
+    wchar_t temp_dir[MAX_PATH + 1];
+    wchar_t temp_path[MAX_PATH + 1];
+    if (!GetTempPathW(IM_ARRAYSIZE(temp_dir), temp_dir) || !GetTempFileNameW(temp_dir, L"brg", 0, temp_path))
+    {
+        Win32OutputLastError();
+        return 0;
+    }
+
+    HANDLE file = CreateFileW(temp_path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, 0,
+                              CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, 0);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        Win32OutputLastError();
+        return 0;
+    }
+    track_handle_opened(file);
+    return file;
+}
+
+// NOTE(irwin): WriteFile takes a DWORD. A burst is nowhere near that, but a single line can be,
+// it's all parsed at once when its LF finally arrives.
+static const size_t SPILL_WRITE_MAX_SIZE = 1024 * 1024 * 1024;
+
+static bool spill_file_write(HANDLE file, const void *data, size_t size)
+{
+    const char *at = (const char *)data;
+    while (size > 0)
+    {
+        DWORD write_size = (DWORD)ImMin(size, SPILL_WRITE_MAX_SIZE);
+        DWORD written = 0;
+        if (!WriteFile(file, at, write_size, &written, 0) || written != write_size)
+        {
+            return false;
+        }
+        at += written;
+        size -= written;
+    }
+    return true;
+}
+
+static void spill_window_release(Spill_Window *window)
+{
+    if (window->view)
+    {
+        UnmapViewOfFile(window->view);
+    }
+    close_tracked_handle(&window->mapping);
+    *window = {};
+}
+
+// NOTE(irwin): returns a pointer to `offset` in the file, valid until the next call on this window
+static const char *spill_window_map(Spill_Window *window, HANDLE file, long long offset, long long size)
+{
+    if (window->view && offset >= window->view_offset && offset + size <= window->view_offset + window->view_size)
+    {
+        return window->view + (offset - window->view_offset);
+    }
+
+    if (window->view)
+    {
+        UnmapViewOfFile(window->view);
+        window->view = 0;
+    }
+
+    // NOTE(irwin): a mapping can't grow with its file, make a new one that covers everything
+    // written so far
+    if (offset + size > window->mapping_size)
+    {
+        close_tracked_handle(&window->mapping);
+        window->mapping_size = 0;
+
+        LARGE_INTEGER file_size = {};
+        if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart < offset + size)
+        {
+            return 0;
+        }
+        window->mapping = CreateFileMappingW(file, 0, PAGE_READONLY, (DWORD)(file_size.QuadPart >> 32), (DWORD)file_size.QuadPart, 0);
+        if (!window->mapping)
+        {
+            Win32OutputLastError();
+            return 0;
+        }
+        track_handle_opened(window->mapping);
+        window->mapping_size = file_size.QuadPart;
+    }
+
+    long long view_offset = offset & ~(SPILL_VIEW_ALIGNMENT - 1);
+    long long view_end = ImMin(window->mapping_size, ImMax(offset + size, view_offset + SPILL_VIEW_MIN_SIZE));
+    window->view = (const char *)MapViewOfFile(window->mapping, FILE_MAP_READ, (DWORD)(view_offset >> 32), (DWORD)view_offset, (SIZE_T)(view_end - view_offset));
+    if (!window->view)
+    {
+        Win32OutputLastError();
+        return 0;
+    }
+    window->view_offset = view_offset;
+    window->view_size = view_end - view_offset;
+    return window->view + (offset - view_offset);
+}
+
+static bool result_store_init(Result_Store *store, Output_Format format, int row_fields, bool spill)
+{
+    store->format = format;
+    store->row_fields = row_fields;
+    store->last_path_id = PATH_ID_NONE;
+    store->heading_path_id = PATH_ID_NONE;
+    if (!virtual_buffer_reserve(&store->text, RESULT_STORE_TEXT_RESERVE) ||
+        !virtual_buffer_reserve(&store->rows, RESULT_STORE_ROWS_RESERVE))
+    {
+        return false;
+    }
+
+    store->spill = spill;
+    if (spill)
+    {
+        store->text_file = create_spill_file();
+        store->rows_file = create_spill_file();
+        return store->text_file && store->rows_file;
+    }
+    return true;
+}
+
+static void result_store_release(Result_Store *store)
+{
+    virtual_buffer_release(&store->text);
+    virtual_buffer_release(&store->rows);
+    path_table_release(&store->paths);
+    virtual_buffer_release(&store->path_spans);
+    spill_window_release(&store->text_window);
+    spill_window_release(&store->rows_window);
+    close_tracked_handle(&store->text_file);
+    close_tracked_handle(&store->rows_file);
+}
+
+// NOTE(irwin): ingest thread, spill mode. The parsed part of the text goes to text_file and rows
+// parsed since the last call go to rows_file with offsets into text_file, both before anything
+// gets published. The parsers may rewrite the text they've parsed (json unescapes in place), so
+// nothing is written before that. Only the unparsed tail stays in memory, it starts just past
+// the LF of the last parsed line.
+static bool result_store_spill(Result_Store *store)
+{
+    if (!spill_file_write(store->text_file, store->text.base, (size_t)store->parse_cursor))
+    {
+        return false;
+    }
+
+    ParsedLine *rows = (ParsedLine *)store->rows.base;
+    int row_count = (int)(store->rows.used / sizeof(ParsedLine));
+    long long base = store->text_file_base;
+    for (int row_index = 0; row_index < row_count; ++row_index)
+    {
+        ParsedLine *row = rows + row_index;
+        row->match.first += base;
+        row->match.one_past_last += base;
+    }
+    if (!spill_file_write(store->rows_file, rows, store->rows.used))
+    {
+        return false;
+    }
+    store->rows.used = 0;
+
+    size_t parsed_size = (size_t)store->parse_cursor;
+    memmove(store->text.base, store->text.base + parsed_size, store->text.used - parsed_size);
+    store->text.used -= parsed_size;
+    store->scan_cursor = ImMax(store->scan_cursor - store->parse_cursor, 0ll);
+    store->text_line.line_start -= store->parse_cursor;
+    store->text_line.first_colon -= store->parse_cursor;
+    store->text_line.match_colon -= store->parse_cursor;
+    store->text_file_base += store->parse_cursor;
+    store->parse_cursor = 0;
+    return true;
+}
+
+// NOTE(irwin): ingest thread, PATH_ID_NONE if the path table is full
+static ImU32 result_store_intern_path(Result_Store *store, IndexedString path)
+{
+    const char *name = store->text.base + path.first;
+    int name_size = (int)(path.one_past_last - path.first);
+    ImU32 last_path_id = store->last_path_id;
+    if (last_path_id != PATH_ID_NONE && path_table_size(&store->paths, last_path_id) == name_size &&
+        memcmp(path_table_get(&store->paths, last_path_id), name, (size_t)name_size) == 0)
+    {
+        return last_path_id;
+    }
+    store->last_path_id = path_table_intern(&store->paths, name, name_size);
+    return store->last_path_id;
+}
+
+// NOTE(irwin): row.path_id has to be set already
+static bool result_store_append_row(Result_Store *store, ParsedLine row)
+{
+    if (store->parsed_row_count == RESULT_STORE_MAX_ROWS || !virtual_buffer_ensure(&store->rows, sizeof(ParsedLine)))
+    {
+        return false;
+    }
+
+    *(ParsedLine *)(store->rows.base + store->rows.used) = row;
+    store->rows.used += sizeof(ParsedLine);
+    store->parsed_row_count++;
+    path_table_add_rows(&store->paths, row.path_id, 1);
+    return true;
+}
+
+// NOTE(irwin): path is the row's path in the text, row.path_id gets filled in
+static bool result_store_push_row(Result_Store *store, ParsedLine row, IndexedString path)
+{
+    if (store->defer_paths)
+    {
+        if (!virtual_buffer_ensure(&store->path_spans, sizeof(IndexedString)))
+        {
+            return false;
+        }
+        *(IndexedString *)(store->path_spans.base + store->path_spans.used) = path;
+        row.path_id = PATH_ID_NONE;
+        if (!result_store_append_row(store, row))
+        {
+            return false;
+        }
+        store->path_spans.used += sizeof(IndexedString);
+        return true;
+    }
+
+    row.path_id = result_store_intern_path(store, path);
+    return row.path_id != PATH_ID_NONE && result_store_append_row(store, row);
+}
+
+static void result_store_publish(Result_Store *store)
+{
+    // NOTE(irwin): full barriers, paths, rows and text written above become visible before the
+    // counts, and the paths before the rows that point at them
+    InterlockedExchange(&store->published_path_count, store->paths.entry_count);
+    InterlockedExchange(&store->published_row_count, store->parsed_row_count);
+}
+
+// NOTE(irwin): NUL-terminated, ui thread, for the path of a published row
+static inline const char *result_store_path(Result_Store *store, ImU32 path_id)
+{
+    return path_table_get(&store->paths, path_id);
+}
+
+static inline int result_store_path_size(Result_Store *store, ImU32 path_id)
+{
+    return path_table_size(&store->paths, path_id);
+}
+
+static inline int result_store_published_row_count(Result_Store *store)
+{
+    return (int)InterlockedCompareExchange(&store->published_row_count, 0, 0);
+}
+
+// NOTE(irwin): rows [first_row, first_row + row_count) of a store, offsets relative to `text`
+struct Result_Window
+{
+    int first_row;
+    int row_count;
+    const ParsedLine *rows;
+    const char *text;
+    long long text_first;
+};
+
+static inline ParsedLine result_window_row(Result_Window *window, int row)
+{
+    ParsedLine line = window->rows[row - window->first_row];
+    line.match.first -= window->text_first;
+    line.match.one_past_last -= window->text_first;
+    return line;
+}
+
+static inline int parsed_line_submatch_count(ParsedLine *line)
+{
+    return (line->submatches.one_past_last - line->submatches.first) / (int)sizeof(Row_Span);
+}
+
+// NOTE(irwin): relative to line->match.first
+static inline Row_Span parsed_line_submatch(const char *text, ParsedLine *line, int index)
+{
+    Row_Span submatch;
+    memcpy(&submatch, text + line->match.first + line->submatches.first + index * (int)sizeof(Row_Span), sizeof(submatch));
+    return submatch;
+}
+
+// NOTE(irwin): ui thread, rows must be published. In spill mode this maps the rows and then the
+// text they point at, the window is valid until the next call.
+static bool result_store_window(Result_Store *store, int first_row, int row_count, Result_Window *window)
+{
+    *window = {};
+    window->first_row = first_row;
+    window->row_count = row_count;
+    if (!store->spill)
+    {
+        window->rows = (const ParsedLine *)store->rows.base + first_row;
+        window->text = store->text.base;
+        return true;
+    }
+    if (row_count <= 0)
+    {
+        return true;
+    }
+
+    const ParsedLine *rows = (const ParsedLine *)spill_window_map(&store->rows_window, store->rows_file,
+                                                                  (long long)first_row * (long long)sizeof(ParsedLine),
+                                                                  (long long)row_count * (long long)sizeof(ParsedLine));
+    if (!rows)
+    {
+        return false;
+    }
+
+    long long text_first = LLONG_MAX;
+    long long text_one_past_last = 0;
+    for (int row_index = 0; row_index < row_count; ++row_index)
+    {
+        const ParsedLine *row = rows + row_index;
+        text_first = ImMin(text_first, row->match.first);
+        text_one_past_last = ImMax(text_one_past_last, row->match.one_past_last);
+        if (row->submatches.one_past_last > row->submatches.first)
+        {
+            text_first = ImMin(text_first, row->match.first + row->submatches.first);
+            text_one_past_last = ImMax(text_one_past_last, row->match.first + row->submatches.one_past_last);
+        }
+    }
+    const char *text = spill_window_map(&store->text_window, store->text_file, text_first, text_one_past_last - text_first);
+    if (!text)
+    {
+        return false;
+    }
+
+    window->rows = rows;
+    window->text = text;
+    window->text_first = text_first;
+    return true;
+}
+
+// NOTE(irwin): rg --json is one message per line, raw newlines only ever end a message. We only
+// pull out what a row needs, strings are unescaped in place in the store's text, which is
+// ours to scribble over, and everything else is skipped without building anything.
+static inline int find_first_set_bit(unsigned int mask)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (int)index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+static inline int find_first_set_bit_64(ImU64 mask)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, mask);
+    return (int)index;
+#else
+    return __builtin_ctzll(mask);
+#endif
+}
+
+// NOTE(irwin): the only structural characters inside a string are the closing quote and
+// backslash, so that's all we look for, 16 bytes at a time
+static inline char *json_find_quote_or_backslash(char *at, char *end)
+{
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    while (end - at >= 16)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)at);
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)));
+        if (mask)
+        {
+            return at + find_first_set_bit((unsigned int)mask);
+        }
+        at += 16;
+    }
+    while (at < end && *at != '"' && *at != '\\')
+    {
+        at++;
+    }
+    return at;
+}
+
+struct Json_Scanner
+{
+    char *at;
+    char *end;
+};
+
+static inline void json_skip_whitespace(Json_Scanner *scanner)
+{
+    while (scanner->at < scanner->end && (*scanner->at == ' ' || *scanner->at == '\t' || *scanner->at == '\r' || *scanner->at == '\n'))
+    {
+        scanner->at++;
+    }
+}
+
+static inline bool json_eat(Json_Scanner *scanner, char ch)
+{
+    json_skip_whitespace(scanner);
+    if (scanner->at < scanner->end && *scanner->at == ch)
+    {
+        scanner->at++;
+        return true;
+    }
+    return false;
+}
+
+static inline int json_hex_digit(char ch)
+{
+    if (ch >= '0' && ch <= '9') return ch - '0';
+    if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+    if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+    return -1;
+}
+
+static bool json_read_hex4(Json_Scanner *scanner, unsigned int *value)
+{
+    if (scanner->end - scanner->at < 4)
+    {
+        return false;
+    }
+    unsigned int result = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        int digit = json_hex_digit(scanner->at[i]);
+        if (digit < 0)
+        {
+            return false;
+        }
+        result = (result << 4) | (unsigned int)digit;
+    }
+    scanner->at += 4;
+    *value = result;
+    return true;
+}
+
+static char *utf8_encode(char *write, unsigned int codepoint)
+{
+    if (codepoint < 0x80)
+    {
+        *write++ = (char)codepoint;
+    }
+    else if (codepoint < 0x800)
+    {
+        *write++ = (char)(0xC0 | (codepoint >> 6));
+        *write++ = (char)(0x80 | (codepoint & 0x3F));
+    }
+    else if (codepoint < 0x10000)
+    {
+        *write++ = (char)(0xE0 | (codepoint >> 12));
+        *write++ = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+        *write++ = (char)(0x80 | (codepoint & 0x3F));
+    }
+    else
+    {
+        *write++ = (char)(0xF0 | (codepoint >> 18));
+        *write++ = (char)(0x80 | ((codepoint >> 12) & 0x3F));
+        *write++ = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+        *write++ = (char)(0x80 | (codepoint & 0x3F));
+    }
+    return write;
+}
+
+// NOTE(irwin): unescapes in place, the result never outgrows the escaped string (a \u escape is
+// 6 bytes for at most 3 bytes of utf8, a surrogate pair 12 for 4)
+static bool json_read_string(Json_Scanner *scanner, char **first, int *size)
+{
+    if (!json_eat(scanner, '"'))
+    {
+        return false;
+    }
+
+    char *write = scanner->at;
+    *first = write;
+    for (;;)
+    {
+        char *stop = json_find_quote_or_backslash(scanner->at, scanner->end);
+        if (write != scanner->at)
+        {
+            memmove(write, scanner->at, (size_t)(stop - scanner->at));
+        }
+        write += stop - scanner->at;
+        scanner->at = stop;
+
+        if (stop == scanner->end || scanner->end - stop < 2)
+        {
+            return false;
+        }
+        if (*stop == '"')
+        {
+            scanner->at++;
+            break;
+        }
+
+        char escaped = stop[1];
+        scanner->at += 2;
+        switch (escaped)
+        {
+            case '"':
+            case '\\':
+            case '/': *write++ = escaped; break;
+            case 'b': *write++ = '\b'; break;
+            case 'f': *write++ = '\f'; break;
+            case 'n': *write++ = '\n'; break;
+            case 'r': *write++ = '\r'; break;
+            case 't': *write++ = '\t'; break;
+            case 'u':
+            {
+                unsigned int codepoint = 0;
+                if (!json_read_hex4(scanner, &codepoint))
+                {
+                    return false;
+                }
+                if (codepoint >= 0xD800 && codepoint < 0xDC00 &&
+                    scanner->end - scanner->at >= 6 && scanner->at[0] == '\\' && scanner->at[1] == 'u')
+                {
+                    Json_Scanner low_scanner = { scanner->at + 2, scanner->end };
+                    unsigned int low = 0;
+                    if (json_read_hex4(&low_scanner, &low) && low >= 0xDC00 && low < 0xE000)
+                    {
+                        codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+                        scanner->at = low_scanner.at;
+                    }
+                }
+                write = utf8_encode(write, codepoint);
+            } break;
+
+            default:
+            {
+                return false;
+            } break;
+        }
+    }
+
+    *size = (int)(write - *first);
+    return true;
+}
+
+// NOTE(irwin): rg falls back to {"bytes": base64} for anything that isn't valid utf8, decoded in
+// place like everything else
+static bool base64_decode_in_place(char *first, int *size)
+{
+    unsigned int bits = 0;
+    int bit_count = 0;
+    char *write = first;
+    for (int i = 0; i < *size; ++i)
+    {
+        char ch = first[i];
+        int value = -1;
+        if (ch >= 'A' && ch <= 'Z') value = ch - 'A';
+        else if (ch >= 'a' && ch <= 'z') value = ch - 'a' + 26;
+        else if (ch >= '0' && ch <= '9') value = ch - '0' + 52;
+        else if (ch == '+') value = 62;
+        else if (ch == '/') value = 63;
+        else if (ch == '=') break;
+        else return false;
+
+        bits = (bits << 6) | (unsigned int)value;
+        bit_count += 6;
+        if (bit_count >= 8)
+        {
+            bit_count -= 8;
+            *write++ = (char)((bits >> bit_count) & 0xFF);
+        }
+    }
+    *size = (int)(write - first);
+    return true;
+}
+
+// NOTE(irwin): keys are short and never escaped by rg, still goes through the same path
+static inline bool json_key_is(const char *key, int key_size, const char *name)
+{
+    int name_size = (int)strlen(name);
+    return key_size == name_size && memcmp(key, name, (size_t)name_size) == 0;
+}
+
+// NOTE(irwin): non-negative integer or null, null reads as -1. rg never writes a sign, a fraction
+// or an exponent for the fields read with this, anything but digits fails the field.
+static bool json_read_integer(Json_Scanner *scanner, long long *value)
+{
+    json_skip_whitespace(scanner);
+    char *start = scanner->at;
+    if (scanner->end - start >= 4 && memcmp(start, "null", 4) == 0)
+    {
+        scanner->at += 4;
+        *value = -1;
+        return true;
+    }
+    if (start == scanner->end || *start < '0' || *start > '9')
+    {
+        return false;
+    }
+
+    long long result = 0;
+    while (scanner->at < scanner->end && *scanner->at >= '0' && *scanner->at <= '9')
+    {
+        // NOTE(irwin): 18 digits always fit
+        if (scanner->at - start == 18)
+        {
+            return false;
+        }
+        result = result * 10 + (*scanner->at - '0');
+        scanner->at++;
+    }
+    *value = result;
+    return true;
+}
+
+static bool json_skip_value(Json_Scanner *scanner)
+{
+    json_skip_whitespace(scanner);
+    int depth = 0;
+    while (scanner->at < scanner->end)
+    {
+        char ch = *scanner->at;
+        if (ch == '"')
+        {
+            scanner->at++;
+            for (;;)
+            {
+                scanner->at = json_find_quote_or_backslash(scanner->at, scanner->end);
+                if (scanner->at >= scanner->end)
+                {
+                    return false;
+                }
+                if (*scanner->at == '"')
+                {
+                    scanner->at++;
+                    break;
+                }
+                scanner->at += 2;
+            }
+        }
+        else if (ch == '{' || ch == '[')
+        {
+            depth++;
+            scanner->at++;
+        }
+        else if (ch == '}' || ch == ']')
+        {
+            if (depth == 0)
+            {
+                return true;
+            }
+            depth--;
+            scanner->at++;
+        }
+        else if (ch == ',' && depth == 0)
+        {
+            return true;
+        }
+        else
+        {
+            scanner->at++;
+        }
+
+        if (depth == 0 && (ch == '"' || ch == '}' || ch == ']'))
+        {
+            return true;
+        }
+    }
+    return depth == 0;
+}
+
+// NOTE(irwin): {"text": "..."} or {"bytes": "base64"}
+static bool json_read_data_string(Json_Scanner *scanner, char *text, IndexedString *result)
+{
+    if (!json_eat(scanner, '{'))
+    {
+        return false;
+    }
+
+    bool found = false;
+    if (!json_eat(scanner, '}'))
+    {
+        do
+        {
+            char *key = 0;
+            int key_size = 0;
+            if (!json_read_string(scanner, &key, &key_size) || !json_eat(scanner, ':'))
+            {
+                return false;
+            }
+
+            bool is_text = json_key_is(key, key_size, "text");
+            if (is_text || json_key_is(key, key_size, "bytes"))
+            {
+                char *first = 0;
+                int size = 0;
+                if (!json_read_string(scanner, &first, &size) || (!is_text && !base64_decode_in_place(first, &size)))
+                {
+                    return false;
+                }
+                result->first = first - text;
+                result->one_past_last = result->first + size;
+                found = true;
+            }
+            else if (!json_skip_value(scanner))
+            {
+                return false;
+            }
+        } while (json_eat(scanner, ','));
+
+        if (!json_eat(scanner, '}'))
+        {
+            return false;
+        }
+    }
+    return found;
+}
+
+// NOTE(irwin): [{"match": {...}, "start": 4, "end": 9}, ...] gets packed as Row_Span[] over the
+// array's own bytes. Each element takes at least 38 bytes of json and 8 packed, so the write never
+// catches up with what's still being read.
+static bool parse_json_submatches(Json_Scanner *scanner, char *text, IndexedString *submatches)
+{
+    json_skip_whitespace(scanner);
+    char *packed = scanner->at;
+    submatches->first = packed - text;
+    if (!json_eat(scanner, '['))
+    {
+        return false;
+    }
+
+    if (!json_eat(scanner, ']'))
+    {
+        do
+        {
+            if (!json_eat(scanner, '{'))
+            {
+                return false;
+            }
+
+            Row_Span span = {};
+            do
+            {
+                char *key = 0;
+                int key_size = 0;
+                if (!json_read_string(scanner, &key, &key_size) || !json_eat(scanner, ':'))
+                {
+                    return false;
+                }
+
+                bool is_start = json_key_is(key, key_size, "start");
+                if (is_start || json_key_is(key, key_size, "end"))
+                {
+                    long long value = 0;
+                    if (!json_read_integer(scanner, &value))
+                    {
+                        return false;
+                    }
+                    (is_start ? span.first : span.one_past_last) = (int)value;
+                }
+                else if (!json_skip_value(scanner))
+                {
+                    return false;
+                }
+            } while (json_eat(scanner, ','));
+
+            if (!json_eat(scanner, '}'))
+            {
+                return false;
+            }
+            memcpy(packed, &span, sizeof(span));
+            packed += sizeof(span);
+        } while (json_eat(scanner, ','));
+
+        if (!json_eat(scanner, ']'))
+        {
+            return false;
+        }
+    }
+
+    submatches->one_past_last = packed - text;
+    return true;
+}
+
+// NOTE(irwin): the "data" of a "match" message
+static bool parse_json_match(Json_Scanner *scanner, char *text, ParsedLine *row, IndexedString *path)
+{
+    if (!json_eat(scanner, '{'))
+    {
+        return false;
+    }
+
+    bool has_path = false;
+    bool has_lines = false;
+    IndexedString submatches = {};
+    do
+    {
+        char *key = 0;
+        int key_size = 0;
+        if (!json_read_string(scanner, &key, &key_size) || !json_eat(scanner, ':'))
+        {
+            return false;
+        }
+
+        bool ok = true;
+        if (json_key_is(key, key_size, "path"))
+        {
+            ok = has_path = json_read_data_string(scanner, text, path);
+        }
+        else if (json_key_is(key, key_size, "lines"))
+        {
+            ok = has_lines = json_read_data_string(scanner, text, &row->match);
+        }
+        else if (json_key_is(key, key_size, "line_number"))
+        {
+            long long line_number = 0;
+            ok = json_read_integer(scanner, &line_number);
+            row->line_number = line_number > 0 && line_number <= INT_MAX ? (int)line_number : 0;
+        }
+        else if (json_key_is(key, key_size, "absolute_offset"))
+        {
+            ok = json_read_integer(scanner, &row->absolute_offset);
+        }
+        else if (json_key_is(key, key_size, "submatches"))
+        {
+            ok = parse_json_submatches(scanner, text, &submatches);
+        }
+        else
+        {
+            ok = json_skip_value(scanner);
+        }
+
+        if (!ok)
+        {
+            return false;
+        }
+    } while (json_eat(scanner, ','));
+
+    // NOTE(irwin): --column is ignored with --json, the first submatch says the same thing.
+    // Both are in the same message, so they're always within an int of each other.
+    if (submatches.one_past_last > submatches.first)
+    {
+        Row_Span first_submatch;
+        memcpy(&first_submatch, text + submatches.first, sizeof(first_submatch));
+        row->column = first_submatch.first + 1;
+        row->submatches.first = (int)(submatches.first - row->match.first);
+        row->submatches.one_past_last = (int)(submatches.one_past_last - row->match.first);
+    }
+
+    // NOTE(irwin): "lines" keeps its line terminator, the text parser doesn't
+    while (row->match.one_past_last > row->match.first &&
+           (text[row->match.one_past_last - 1] == '\n' || text[row->match.one_past_last - 1] == '\r'))
+    {
+        row->match.one_past_last--;
+    }
+
+    return json_eat(scanner, '}') && has_path && has_lines;
+}
+
+// NOTE(irwin): true if the message is a match and `row` and `path` got filled. begin/context/end/
+// summary are recognized and skipped, rg always puts "type" before "data".
+static bool parse_json_message(Json_Scanner *scanner, char *text, ParsedLine *row, IndexedString *path)
+{
+    if (!json_eat(scanner, '{'))
+    {
+        return false;
+    }
+
+    bool is_match = false;
+    bool has_row = false;
+    do
+    {
+        char *key = 0;
+        int key_size = 0;
+        if (!json_read_string(scanner, &key, &key_size) || !json_eat(scanner, ':'))
+        {
+            return false;
+        }
+
+        if (json_key_is(key, key_size, "type"))
+        {
+            char *type = 0;
+            int type_size = 0;
+            if (!json_read_string(scanner, &type, &type_size))
+            {
+                return false;
+            }
+            is_match = json_key_is(type, type_size, "match");
+        }
+        else if (is_match && json_key_is(key, key_size, "data"))
+        {
+            *row = {};
+            row->absolute_offset = -1;
+            has_row = parse_json_match(scanner, text, row, path);
+            if (!has_row)
+            {
+                return false;
+            }
+        }
+        else if (!json_skip_value(scanner))
+        {
+            return false;
+        }
+    } while (json_eat(scanner, ','));
+
+    return has_row && json_eat(scanner, '}');
+}
+
+// NOTE(irwin): the LF ending the line at parse_cursor, 0 if it hasn't arrived yet. Whatever an
+// earlier call already searched isn't searched again.
+static char *find_line_end(Result_Store *store)
+{
+    long long from = ImMax(store->parse_cursor, store->scan_cursor);
+    char *newline = (char *)memchr(store->text.base + from, '\n', store->text.used - (size_t)from);
+    if (!newline)
+    {
+        store->scan_cursor = (long long)store->text.used;
+    }
+    return newline;
+}
+
+// NOTE(irwin): parse_cursor is just past the LF of the last message. A malformed message gets
+// skipped whole instead of stalling the rest of the output.
+static int parse_rg_json(Result_Store *store)
+{
+    int rows_before = store->parsed_row_count;
+    char *text = store->text.base;
+    while (store->parse_cursor < (long long)store->text.used)
+    {
+        char *message = text + store->parse_cursor;
+        char *newline = find_line_end(store);
+        if (!newline)
+        {
+            break;
+        }
+
+        Json_Scanner scanner = { message, newline };
+        ParsedLine row;
+        IndexedString path;
+        if (parse_json_message(&scanner, text, &row, &path) && !result_store_push_row(store, row, path))
+        {
+            break;
+        }
+        store->parse_cursor = newline + 1 - text;
+    }
+    return store->parsed_row_count - rows_before;
+}
+
+// NOTE(irwin): false unless it's nothing but digits and at most max_value
+static inline bool parse_row_number(const char *first, const char *one_past_last, long long max_value, long long *value)
+{
+    if (first == one_past_last || one_past_last - first > 18)
+    {
+        return false;
+    }
+    long long result = 0;
+    for (const char *at = first; at < one_past_last; ++at)
+    {
+        if (*at < '0' || *at > '9')
+        {
+            return false;
+        }
+        result = result * 10 + (*at - '0');
+    }
+    *value = result;
+    return result <= max_value;
+}
+
+// NOTE(irwin): a number and the colon after it, `at` ends up past the colon
+static inline bool read_row_number(const char **at, const char *line_end, long long max_value, long long *value)
+{
+    const char *separator = (const char *)memchr(*at, ':', (size_t)(line_end - *at));
+    if (!separator || !parse_row_number(*at, separator, max_value, value))
+    {
+        return false;
+    }
+    *at = separator + 1;
+    return true;
+}
+
+// NOTE(irwin): "line:" then "column:" and "offset:" if rg was asked for them. Returns where the
+// match starts, 0 if one of them is missing or isn't a number, e.g. a context line (line-match) or
+// rg run without -n.
+static const char *parse_row_numbers(int row_fields, const char *at, const char *line_end, ParsedLine *row)
+{
+    long long value = 0;
+    if (!read_row_number(&at, line_end, INT_MAX, &value))
+    {
+        return 0;
+    }
+    row->line_number = (int)value;
+    if (row_fields & Row_Field_Column)
+    {
+        if (!read_row_number(&at, line_end, INT_MAX, &value))
+        {
+            return 0;
+        }
+        row->column = (int)value;
+    }
+    if (row_fields & Row_Field_Byte_Offset)
+    {
+        if (!read_row_number(&at, line_end, LLONG_MAX, &value))
+        {
+            return 0;
+        }
+        row->absolute_offset = value;
+    }
+    return at;
+}
+
+// NOTE(irwin): colons in a text line up to and including the one before the match
+static inline int text_line_colon_total(int row_fields)
+{
+    return 2 + ((row_fields & Row_Field_Column) ? 1 : 0) + ((row_fields & Row_Field_Byte_Offset) ? 1 : 0);
+}
+
+// NOTE(irwin): "path:line:match\n", with "column:" and "offset:" before the match if rg was
+// asked for them. The path ends at the first colon, unless that's a drive letter's, the numbers
+// follow, the match ends at the LF (a CR before it isn't part of it). A line without enough
+// colons, or numbers that aren't, is skipped. parse_cursor is just past the LF of the last line,
+// a line still waiting for its LF keeps its colons in text_line and the next read carries on
+// from scan_cursor.
+//
+// 64 bytes at a time: a bitmask of LFs and one of colons, then only the set bits are visited, in
+// order. Once a line has all of its colons the rest of its colons are dropped from the mask, so a
+// long match costs one compare per byte and nothing else.
+static inline void text_line_reset(Text_Line_State *state, long long line_start)
+{
+    state->line_start = line_start;
+    state->colon_count = 0;
+}
+
+// NOTE(irwin): "C:\path" or "C:/path" is a drive letter, not a field separator; a one-character
+// relative path like "a:12:match" still splits there. False if that can't be told yet because
+// the byte after the colon hasn't arrived, the colon gets looked at again on the next read.
+static inline bool text_line_colon(Text_Line_State *state, const char *text, long long size, long long position, int colon_total)
+{
+    if (state->colon_count == 0)
+    {
+        if (position == state->line_start + 1)
+        {
+            if (position + 1 >= size)
+            {
+                return false;
+            }
+            if (text[position + 1] == '\\' || text[position + 1] == '/')
+            {
+                return true;
+            }
+        }
+        state->first_colon = position;
+        state->colon_count = 1;
+    }
+    else if (state->colon_count < colon_total)
+    {
+        state->match_colon = position;
+        state->colon_count++;
+    }
+    return true;
+}
+
+// NOTE(irwin): false if the row couldn't be stored, parse_cursor stays at the start of the line
+static inline bool text_line_end(Result_Store *store, Text_Line_State *state, const char *text, long long newline, int colon_total)
+{
+    ParsedLine row = {};
+    row.absolute_offset = -1;
+    if (state->colon_count == colon_total && state->first_colon > state->line_start &&
+        parse_row_numbers(store->row_fields, text + state->first_colon + 1, text + state->match_colon + 1, &row))
+    {
+        long long match_end = newline;
+        if (match_end > state->match_colon + 1 && text[match_end - 1] == '\r')
+        {
+            match_end--;
+        }
+
+        IndexedString path = { state->line_start, state->first_colon };
+        row.match.first = state->match_colon + 1;
+        row.match.one_past_last = match_end;
+        if (!result_store_push_row(store, row, path))
+        {
+            return false;
+        }
+    }
+    store->parse_cursor = newline + 1;
+    text_line_reset(state, newline + 1);
+    return true;
+}
+
+static inline void text_block_masks(const char *block, ImU64 *newline_mask, ImU64 *colon_mask)
+{
+#if defined(__AVX2__)
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const __m256i colon = _mm256_set1_epi8(':');
+    __m256i low = _mm256_loadu_si256((const __m256i *)block);
+    __m256i high = _mm256_loadu_si256((const __m256i *)(block + 32));
+    *newline_mask = (ImU64)(ImU32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, newline)) |
+                    ((ImU64)(ImU32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, newline)) << 32);
+    *colon_mask = (ImU64)(ImU32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, colon)) |
+                  ((ImU64)(ImU32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, colon)) << 32);
+#else
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i colon = _mm_set1_epi8(':');
+    ImU64 newlines = 0;
+    ImU64 colons = 0;
+    for (int chunk = 0; chunk < 4; ++chunk)
+    {
+        __m128i bytes = _mm_loadu_si128((const __m128i *)(block + chunk * 16));
+        newlines |= (ImU64)(ImU32)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, newline)) << (chunk * 16);
+        colons |= (ImU64)(ImU32)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, colon)) << (chunk * 16);
+    }
+    *newline_mask = newlines;
+    *colon_mask = colons;
+#endif
+}
+
+static int parse_rg_text(Result_Store *store)
+{
+    int rows_before = store->parsed_row_count;
+    const char *text = store->text.base;
+    long long size = (long long)store->text.used;
+
+    Text_Line_State *state = &store->text_line;
+    int colon_total = text_line_colon_total(store->row_fields);
+    long long at = ImMax(store->parse_cursor, store->scan_cursor);
+    for (; at + 64 <= size; at += 64)
+    {
+        ImU64 newline_mask;
+        ImU64 colon_mask;
+        text_block_masks(text + at, &newline_mask, &colon_mask);
+
+        ImU64 pending = newline_mask | (state->colon_count < colon_total ? colon_mask : 0);
+        while (pending)
+        {
+            int bit = find_first_set_bit_64(pending);
+            pending &= pending - 1;
+            if (newline_mask & (1ull << bit))
+            {
+                if (!text_line_end(store, state, text, at + bit, colon_total))
+                {
+                    store->scan_cursor = at + bit;
+                    return store->parsed_row_count - rows_before;
+                }
+                pending |= bit < 63 ? colon_mask & (~0ull << (bit + 1)) : 0;
+            }
+            else
+            {
+                if (!text_line_colon(state, text, size, at + bit, colon_total))
+                {
+                    store->scan_cursor = at + bit;
+                    return store->parsed_row_count - rows_before;
+                }
+                if (state->colon_count == colon_total)
+                {
+                    pending &= newline_mask;
+                }
+            }
+        }
+    }
+
+    for (; at < size; ++at)
+    {
+        if (text[at] == '\n')
+        {
+            if (!text_line_end(store, state, text, at, colon_total))
+            {
+                break;
+            }
+        }
+        else if (text[at] == ':')
+        {
+            if (!text_line_colon(state, text, size, at, colon_total))
+            {
+                break;
+            }
+        }
+    }
+    store->scan_cursor = at;
+    return store->parsed_row_count - rows_before;
+}
+
+// NOTE(irwin): "path\0line:match\n", the path is whatever comes before the NUL, colons and drive
+// letters included, so every field is one memchr away. Paths can't hold an LF, so the record is
+// found first and its fields looked for inside it. parse_cursor is just past the LF of the last
+// record. A record without a NUL or its numbers is skipped.
+static int parse_rg_null(Result_Store *store)
+{
+    int rows_before = store->parsed_row_count;
+    char *text = store->text.base;
+    while (store->parse_cursor < (long long)store->text.used)
+    {
+        char *record = text + store->parse_cursor;
+        char *newline = find_line_end(store);
+        if (!newline)
+        {
+            break;
+        }
+
+        char *nul = (char *)memchr(record, 0, (size_t)(newline - record));
+        ParsedLine row = {};
+        row.absolute_offset = -1;
+        const char *match = nul ? parse_row_numbers(store->row_fields, nul + 1, newline, &row) : 0;
+        if (match)
+        {
+            char *match_end = newline;
+            if (match_end > match && match_end[-1] == '\r')
+            {
+                match_end--;
+            }
+
+            IndexedString path = { record - text, nul - text };
+            row.match.first = match - text;
+            row.match.one_past_last = match_end - text;
+            if (!result_store_push_row(store, row, path))
+            {
+                break;
+            }
+        }
+        store->parse_cursor = newline + 1 - text;
+    }
+    return store->parsed_row_count - rows_before;
+}
+
+// NOTE(irwin): "path\n" then "line:match\n" for each match, then an empty line before the next
+// file. The first line of a block is the path whatever it looks like. parse_cursor is just past
+// the LF of the last line. Context lines (line-match) and lines without their numbers (rg run
+// without -n) are skipped.
+static int parse_rg_heading(Result_Store *store)
+{
+    int rows_before = store->parsed_row_count;
+    char *text = store->text.base;
+    while (store->parse_cursor < (long long)store->text.used)
+    {
+        char *line = text + store->parse_cursor;
+        char *newline = find_line_end(store);
+        if (!newline)
+        {
+            break;
+        }
+        char *line_end = newline;
+        if (line_end > line && line_end[-1] == '\r')
+        {
+            line_end--;
+        }
+
+        if (line_end == line)
+        {
+            store->heading_in_block = false;
+        }
+        else if (!store->heading_in_block)
+        {
+            IndexedString path = { line - text, line_end - text };
+            store->heading_path_id = result_store_intern_path(store, path);
+            if (store->heading_path_id == PATH_ID_NONE)
+            {
+                break;
+            }
+            store->heading_in_block = true;
+        }
+        else
+        {
+            ParsedLine row = {};
+            row.absolute_offset = -1;
+            const char *match = parse_row_numbers(store->row_fields, line, line_end, &row);
+            if (match)
+            {
+                row.path_id = store->heading_path_id;
+                row.match.first = match - text;
+                row.match.one_past_last = line_end - text;
+                if (!result_store_append_row(store, row))
+                {
+                    break;
+                }
+            }
+        }
+        store->parse_cursor = newline + 1 - text;
+    }
+    return store->parsed_row_count - rows_before;
+}
+
+static int parse_result_store(Result_Store *store)
+{
+    if (store->format == Output_Format_Json)
+    {
+        return parse_rg_json(store);
+    }
+    if (store->format == Output_Format_Null)
+    {
+        return parse_rg_null(store);
+    }
+    if (store->format == Output_Format_Heading)
+    {
+        return parse_rg_heading(store);
+    }
+
+    return parse_rg_text(store);
+}
+
+// NOTE(irwin): rg can print faster than one thread parses, e.g. a pattern like \w+ matching every
+// word. While it's ahead of us the ingest thread keeps reading up to PARSE_BURST_SIZE, then splits
+// the complete lines at LFs into chunks. Each chunk is parsed on the default thread pool into rows
+// of its own, the ingest thread takes chunks too, and the rows are copied behind the store's in
+// chunk order, so they come out in the same order as parsing it all in one go. The heading format
+// carries the path from line to line, it stays on one thread.
+static const size_t PARSE_BURST_SIZE = 16 * 1024 * 1024;
+static const size_t PARSE_CHUNK_MIN_SIZE = 1024 * 1024;
+static const int PARSE_CHUNK_MAX_COUNT = 16;
+static const size_t PARSE_CHUNK_ROWS_RESERVE = PARSE_BURST_SIZE / SHORTEST_ROW_SIZE * sizeof(ParsedLine) / VIRTUAL_BUFFER_COMMIT_GRANULARITY * VIRTUAL_BUFFER_COMMIT_GRANULARITY + VIRTUAL_BUFFER_COMMIT_GRANULARITY;
+
+// NOTE(irwin): a store of its own that shares the text, only the cursors and rows are used
+struct Parse_Chunk
+{
+    Result_Store store;
+    long long end;
+};
+
+// NOTE(irwin): ingest thread only, kept for the whole run so the row buffers stay committed
+struct Parallel_Parser
+{
+    PTP_WORK work;
+    int worker_count;
+    int chunk_count;
+    volatile LONG next_chunk;
+    Parse_Chunk chunks[PARSE_CHUNK_MAX_COUNT];
+};
+
+static void parallel_parser_release(Parallel_Parser *parser)
+{
+    if (parser->work)
+    {
+        CloseThreadpoolWork(parser->work);
+    }
+    for (int chunk_index = 0; chunk_index < PARSE_CHUNK_MAX_COUNT; ++chunk_index)
+    {
+        virtual_buffer_release(&parser->chunks[chunk_index].store.rows);
+        virtual_buffer_release(&parser->chunks[chunk_index].store.path_spans);
+    }
+    *parser = {};
+}
+
+static void parse_claimed_chunks(Parallel_Parser *parser)
+{
+    for (;;)
+    {
+        int chunk_index = (int)InterlockedIncrement(&parser->next_chunk) - 1;
+        if (chunk_index >= parser->chunk_count)
+        {
+            break;
+        }
+        parse_result_store(&parser->chunks[chunk_index].store);
+    }
+}
+
+static VOID CALLBACK parse_chunk_work_proc(PTP_CALLBACK_INSTANCE instance, PVOID context, PTP_WORK work)
+{
+    (void)instance;
+    (void)work;
+    parse_claimed_chunks((Parallel_Parser *)context);
+}
+
+// NOTE(irwin): ingest thread. Parses the complete lines past parse_cursor, 0 rows and nothing
+// touched if there aren't enough of them to be worth splitting up; parse_result_store still
+// runs after this for whatever is left. A chunk that ran out of rows ends the splice there, the
+// rest gets parsed again by parse_result_store.
+static int parse_result_store_parallel(Result_Store *store, Parallel_Parser *parser)
+{
+    if (store->format == Output_Format_Heading)
+    {
+        return 0;
+    }
+
+    const char *text = store->text.base;
+    long long begin = store->parse_cursor;
+    long long end = (long long)store->text.used;
+    if (end - begin < (long long)(2 * PARSE_CHUNK_MIN_SIZE))
+    {
+        return 0;
+    }
+    // NOTE(irwin): there's no LF between parse_cursor and scan_cursor, a long line still waiting
+    // for its LF only gets the bytes that arrived since the last read looked at
+    long long no_newline_end = ImMax(begin, store->scan_cursor);
+    while (end > no_newline_end && text[end - 1] != '\n')
+    {
+        end--;
+    }
+    if (end == no_newline_end)
+    {
+        end = begin;
+    }
+
+    if (!parser->worker_count)
+    {
+        parser->worker_count = ImClamp((int)GetActiveProcessorCount(ALL_PROCESSOR_GROUPS), 1, PARSE_CHUNK_MAX_COUNT);
+    }
+    size_t size = (size_t)(end - begin);
+    int chunk_count = ImMin((int)(size / PARSE_CHUNK_MIN_SIZE), parser->worker_count);
+    if (chunk_count < 2)
+    {
+        return 0;
+    }
+    if (!parser->work)
+    {
+        parser->work = CreateThreadpoolWork(parse_chunk_work_proc, parser, 0);
+        if (!parser->work)
+        {
+            Win32OutputLastError();
+            return 0;
+        }
+    }
+
+    long long chunk_begin = begin;
+    int split_count = 0;
+    while (split_count < chunk_count && chunk_begin < end)
+    {
+        long long chunk_end = end;
+        if (split_count + 1 < chunk_count)
+        {
+            long long target = ImMax(begin + (long long)(size * (size_t)(split_count + 1) / (size_t)chunk_count), chunk_begin);
+            chunk_end = (const char *)memchr(text + target, '\n', (size_t)(end - target)) + 1 - text;
+        }
+
+        Parse_Chunk *chunk = parser->chunks + split_count;
+        if (!chunk->store.rows.base && (!virtual_buffer_reserve(&chunk->store.rows, PARSE_CHUNK_ROWS_RESERVE) ||
+                                        !virtual_buffer_reserve(&chunk->store.path_spans, PARSE_CHUNK_ROWS_RESERVE)))
+        {
+            return 0;
+        }
+        chunk->store.defer_paths = true;
+        chunk->store.path_spans.used = 0;
+        chunk->store.format = store->format;
+        chunk->store.row_fields = store->row_fields;
+        chunk->store.text.base = store->text.base;
+        chunk->store.text.used = (size_t)chunk_end;
+        chunk->store.rows.used = 0;
+        chunk->store.parse_cursor = chunk_begin;
+        chunk->store.scan_cursor = chunk_begin;
+        text_line_reset(&chunk->store.text_line, chunk_begin);
+        chunk->store.parsed_row_count = 0;
+        chunk->end = chunk_end;
+
+        chunk_begin = chunk_end;
+        split_count++;
+    }
+
+    parser->chunk_count = split_count;
+    parser->next_chunk = 0;
+    for (int worker = 1; worker < split_count; ++worker)
+    {
+        SubmitThreadpoolWork(parser->work);
+    }
+    parse_claimed_chunks(parser);
+    WaitForThreadpoolWorkCallbacks(parser->work, FALSE);
+
+    int splice_count = 0;
+    size_t row_bytes = 0;
+    while (splice_count < split_count)
+    {
+        Parse_Chunk *chunk = parser->chunks + splice_count++;
+        row_bytes += chunk->store.rows.used;
+        if (chunk->store.parse_cursor != chunk->end)
+        {
+            break;
+        }
+    }
+    // NOTE(irwin): near the row limit parse_result_store takes over and stops right at it
+    if (row_bytes / sizeof(ParsedLine) > (size_t)(RESULT_STORE_MAX_ROWS - store->parsed_row_count) ||
+        !virtual_buffer_ensure(&store->rows, row_bytes))
+    {
+        return 0;
+    }
+
+    // NOTE(irwin): paths are interned here, in row order, only this thread touches the table
+    for (int chunk_index = 0; chunk_index < splice_count; ++chunk_index)
+    {
+        Parse_Chunk *chunk = parser->chunks + chunk_index;
+        ParsedLine *rows = (ParsedLine *)chunk->store.rows.base;
+        const IndexedString *paths = (const IndexedString *)chunk->store.path_spans.base;
+        for (int row_index = 0; row_index < chunk->store.parsed_row_count; ++row_index)
+        {
+            rows[row_index].path_id = result_store_intern_path(store, paths[row_index]);
+            if (rows[row_index].path_id == PATH_ID_NONE)
+            {
+                return 0;
+            }
+        }
+    }
+
+    int rows_before = store->parsed_row_count;
+    for (int chunk_index = 0; chunk_index < splice_count; ++chunk_index)
+    {
+        Parse_Chunk *chunk = parser->chunks + chunk_index;
+        const ParsedLine *rows = (const ParsedLine *)chunk->store.rows.base;
+        // NOTE(irwin): a file's rows come one after another, counted a file at a time
+        int path_first_row = 0;
+        for (int row_index = 1; row_index <= chunk->store.parsed_row_count; ++row_index)
+        {
+            if (row_index == chunk->store.parsed_row_count || rows[row_index].path_id != rows[path_first_row].path_id)
+            {
+                path_table_add_rows(&store->paths, rows[path_first_row].path_id, row_index - path_first_row);
+                path_first_row = row_index;
+            }
+        }
+        memcpy(store->rows.base + store->rows.used, chunk->store.rows.base, chunk->store.rows.used);
+        store->rows.used += chunk->store.rows.used;
+        store->parsed_row_count += chunk->store.parsed_row_count;
+    }
+    store->parse_cursor = parser->chunks[splice_count - 1].store.parse_cursor;
+    store->scan_cursor = store->parse_cursor;
+    text_line_reset(&store->text_line, store->parse_cursor);
+    return store->parsed_row_count - rows_before;
+}
+
+static long long g_TimestampFrequency = 1;
+
+static inline long long get_timestamp()
+{
+    LARGE_INTEGER timestamp;
+    QueryPerformanceCounter(&timestamp);
+    return timestamp.QuadPart;
+}
+
+static inline float timestamp_to_ms(long long ticks)
+{
+    return (float)((double)ticks * 1000.0 / (double)g_TimestampFrequency);
+}
+
+// NOTE(irwin): bigger than the default pipe buffer so rg rarely blocks on us
+static const DWORD INGEST_PIPE_SIZE = 1024 * 1024;
+static const DWORD INGEST_READ_SIZE = 256 * 1024;
+
+// NOTE(irwin): what a search daemon sends after rg's output once it read all of it, rg's exit code
+// in hex. There's no LF in it so it's never parsed as a row, the ingest thread takes it off the
+// end. A daemon that hangs up without it didn't get everything rg printed.
+static const char DAEMON_TRAILER_PREFIX[] = "\x1e" "barerg-rg-exit=";
+static const int DAEMON_TRAILER_SIZE = (int)sizeof(DAEMON_TRAILER_PREFIX) - 1 + 8;
+
+// NOTE(irwin): ingest thread, once the daemon hung up. False if the output doesn't end in a trailer.
+static bool take_daemon_trailer(Result_Store *store, DWORD *exit_code)
+{
+    long long trailer_first = (long long)store->text.used - DAEMON_TRAILER_SIZE;
+    if (trailer_first < store->parse_cursor)
+    {
+        return false;
+    }
+    const char *trailer = store->text.base + trailer_first;
+    int prefix_size = (int)sizeof(DAEMON_TRAILER_PREFIX) - 1;
+    if (memcmp(trailer, DAEMON_TRAILER_PREFIX, (size_t)prefix_size) != 0)
+    {
+        return false;
+    }
+    DWORD value = 0;
+    for (int i = prefix_size; i < DAEMON_TRAILER_SIZE; ++i)
+    {
+        char ch = trailer[i];
+        int digit = (ch >= '0' && ch <= '9') ? ch - '0' : (ch >= 'a' && ch <= 'f') ? ch - 'a' + 10 : -1;
+        if (digit < 0)
+        {
+            return false;
+        }
+        value = value * 16 + (DWORD)digit;
+    }
+
+    store->text.used = (size_t)trailer_first;
+    store->bytes_read -= DAEMON_TRAILER_SIZE;
+    store->scan_cursor = ImMin(store->scan_cursor, trailer_first);
+    *exit_code = value;
+    return true;
+}
+
+static DWORD WINAPI ingest_thread_proc(LPVOID parameter)
+{
+    Command *command = (Command *)parameter;
+    Result_Store *store = command->store;
+    Parallel_Parser parser = {};
+
+    bool pipe_closed = false;
+    for (;;)
+    {
+        size_t store_size = store->text.used + store->rows.used;
+        if ((LONGLONG)store_size >= InterlockedCompareExchange64(&command->byte_budget, 0, 0))
+        {
+            InterlockedExchange(&command->ingest_paused, 1);
+            SetEvent(command->wake_event);
+            WaitForSingleObject(command->resume_event, INFINITE);
+            InterlockedExchange(&command->ingest_paused, 0);
+            if (InterlockedCompareExchange(&command->abort_signaled, 0, 0))
+            {
+                break;
+            }
+            continue;
+        }
+
+        // NOTE(irwin): read straight into the store, near the end of the reserve take what's left.
+        // In spill mode the reserve only holds the unparsed tail, the spill file has no limit.
+        size_t read_size = RESULT_STORE_TEXT_RESERVE - store->text.used;
+        if (read_size > INGEST_READ_SIZE)
+        {
+            read_size = INGEST_READ_SIZE;
+        }
+        if (read_size == 0 || !virtual_buffer_ensure(&store->text, read_size))
+        {
+            break;
+        }
+
+        // NOTE(irwin): cancel_command can't kill a daemon's rg, it cancels our read instead. One it
+        // misses by a hair ends when the daemon sends more or hangs up.
+        if (command->remote && InterlockedCompareExchange(&command->abort_signaled, 0, 0))
+        {
+            break;
+        }
+
+        DWORD read = 0;
+        if (!ReadFile(command->stdout_read, store->text.base + store->text.used, (DWORD)read_size, &read, NULL))
+        {
+            // NOTE(irwin): ERROR_BROKEN_PIPE once rg exits or gets killed, or the daemon is done
+            pipe_closed = !command->remote || GetLastError() == ERROR_BROKEN_PIPE;
+            break;
+        }
+        if (read > 0 && !command->first_byte_timestamp)
+        {
+            command->first_byte_timestamp = get_timestamp();
+        }
+        store->text.used += read;
+        store->bytes_read += read;
+
+        // NOTE(irwin): rg is ahead of us, take the whole burst before parsing so it can be split up
+        DWORD available = 0;
+        if (read > 0 && store->text.used - (size_t)store->parse_cursor < PARSE_BURST_SIZE &&
+            (LONGLONG)(store->text.used + store->rows.used) < InterlockedCompareExchange64(&command->byte_budget, 0, 0) &&
+            PeekNamedPipe(command->stdout_read, 0, 0, 0, &available, 0) && available > 0)
+        {
+            continue;
+        }
+
+        long long parse_start = get_timestamp();
+        int lines_parsed = parse_result_store_parallel(store, &parser);
+        lines_parsed += parse_result_store(store);
+        store->parse_ticks += get_timestamp() - parse_start;
+        if (store->spill && !result_store_spill(store))
+        {
+            Win32OutputLastError();
+            break;
+        }
+        if (lines_parsed > 0)
+        {
+            result_store_publish(store);
+            SetEvent(command->wake_event);
+        }
+    }
+
+    // NOTE(irwin): reap here so the ui never waits on rg. If we stopped reading for any other reason
+    // rg may be blocked on a full pipe, so kill it first. Handles are closed by the ui thread in
+    // finish_ingest_thread, cancel_command may still be using the job handle until then.
+    if (!command->remote)
+    {
+        if (!pipe_closed)
+        {
+            TerminateJobObject(command->job, 1);
+        }
+        WaitForSingleObject(command->process_information.hProcess, INFINITE);
+        GetExitCodeProcess(command->process_information.hProcess, &command->exit_code);
+        InterlockedDecrement(&g_ProcessCounters.running);
+        InterlockedIncrement(&g_ProcessCounters.reaped);
+    }
+    if (command->remote && pipe_closed)
+    {
+        pipe_closed = take_daemon_trailer(store, &command->exit_code);
+    }
+    command->drained = pipe_closed;
+    parallel_parser_release(&parser);
+
+    InterlockedExchange(&command->ingest_done, 1);
+    SetEvent(command->wake_event);
+    return 0;
+}
+
+// NOTE(irwin): CreateProcessW's limit for lpCommandLine, including the terminator
+static const int LAUNCH_COMMAND_LINE_CAPACITY = 32768;
+
+// NOTE(irwin): everything a launch needs is preallocated here so starting rg on every keystroke
+// costs no heap allocations. Only the ui thread launches.
+struct Launcher
+{
+    char command_line_utf8[LAUNCH_COMMAND_LINE_CAPACITY];
+    int command_line_utf8_size;
+    bool command_line_overflow;
+    wchar_t command_line[LAUNCH_COMMAND_LINE_CAPACITY];
+
+    // NOTE(irwin): holds a single PROC_THREAD_ATTRIBUTE_HANDLE_LIST, sized once at startup.
+    // inherited_handle must stay put until CreateProcessW returns, the list points at it.
+    void *attribute_list_storage;
+    SIZE_T attribute_list_size;
+    HANDLE inherited_handle;
+};
+
+static Launcher g_Launcher;
+
+static bool launcher_init(Launcher *launcher)
+{
+    SIZE_T size = 0;
+    InitializeProcThreadAttributeList(0, 1, 0, &size);
+    launcher->attribute_list_storage = malloc(size);
+    launcher->attribute_list_size = size;
+    return launcher->attribute_list_storage != 0;
+}
+
+static void launcher_begin(Launcher *launcher)
+{
+    launcher->command_line_utf8_size = 0;
+    launcher->command_line_overflow = false;
+}
+
+static void launcher_push(Launcher *launcher, const char *bytes, int size)
+{
+    // NOTE(irwin): keep room for the terminator
+    if (launcher->command_line_utf8_size + size >= LAUNCH_COMMAND_LINE_CAPACITY)
+    {
+        launcher->command_line_overflow = true;
+        return;
+    }
+    memcpy(launcher->command_line_utf8 + launcher->command_line_utf8_size, bytes, (size_t)size);
+    launcher->command_line_utf8_size += size;
+}
+
+static void launcher_push_repeated(Launcher *launcher, char ch, int count)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        launcher_push(launcher, &ch, 1);
+    }
+}
+
+// NOTE(irwin): already command line syntax, e.g. the user's "rg.exe --line-number" prefix
+static void launcher_append_raw(Launcher *launcher, const char *text)
+{
+    if (launcher->command_line_utf8_size > 0)
+    {
+        launcher_push(launcher, " ", 1);
+    }
+    launcher_push(launcher, text, (int)strlen(text));
+}
+
+// NOTE(irwin): quotes a single argument so CommandLineToArgvW/the CRT give it back verbatim:
+// backslashes are literal unless they precede a quote, then each one has to be doubled
+static void launcher_append_argument(Launcher *launcher, const char *argument)
+{
+    if (launcher->command_line_utf8_size > 0)
+    {
+        launcher_push(launcher, " ", 1);
+    }
+
+    int size = (int)strlen(argument);
+    bool needs_quotes = size == 0;
+    for (int i = 0; i < size && !needs_quotes; ++i)
+    {
+        char ch = argument[i];
+        needs_quotes = ch == ' ' || ch == '\t' || ch == '\n' || ch == '\v' || ch == '"';
+    }
+
+    if (!needs_quotes)
+    {
+        launcher_push(launcher, argument, size);
+        return;
+    }
+
+    launcher_push(launcher, "\"", 1);
+    int backslash_count = 0;
+    for (int i = 0; i < size; ++i)
+    {
+        char ch = argument[i];
+        if (ch == '\\')
+        {
+            backslash_count++;
+        }
+        else if (ch == '"')
+        {
+            launcher_push_repeated(launcher, '\\', backslash_count * 2 + 1);
+            launcher_push(launcher, &ch, 1);
+            backslash_count = 0;
+        }
+        else
+        {
+            launcher_push_repeated(launcher, '\\', backslash_count);
+            launcher_push(launcher, &ch, 1);
+            backslash_count = 0;
+        }
+    }
+    launcher_push_repeated(launcher, '\\', backslash_count * 2);
+    launcher_push(launcher, "\"", 1);
+}
+
+// NOTE(irwin): converts in place into the preallocated wide buffer, null on overflow
+static wchar_t *launcher_finish(Launcher *launcher)
+{
+    if (launcher->command_line_overflow || launcher->command_line_utf8_size == 0)
+    {
+        return 0;
+    }
+
+    int wide_size = MultiByteToWideChar(CP_UTF8, 0, launcher->command_line_utf8, launcher->command_line_utf8_size,
+                                        launcher->command_line, LAUNCH_COMMAND_LINE_CAPACITY - 1);
+    if (wide_size == 0)
+    {
+        Win32OutputLastError();
+        return 0;
+    }
+    launcher->command_line[wide_size] = 0;
+    return launcher->command_line;
+}
+
+// NOTE(irwin): limits replace each other wholesale, so KILL_ON_JOB_CLOSE is restated every time
+static bool apply_job_limits(Command *command)
+{
+    JOBOBJECT_EXTENDED_LIMIT_INFORMATION job_limits = {};
+    job_limits.BasicLimitInformation.LimitFlags = JOB_OBJECT_LIMIT_KILL_ON_JOB_CLOSE | JOB_OBJECT_LIMIT_PRIORITY_CLASS;
+    job_limits.BasicLimitInformation.PriorityClass = command->throttled ? IDLE_PRIORITY_CLASS : command->foreground ? NORMAL_PRIORITY_CLASS : BELOW_NORMAL_PRIORITY_CLASS;
+    return SetInformationJobObject(command->job, JobObjectExtendedLimitInformation, &job_limits, sizeof(job_limits)) != 0;
+}
+
+// NOTE(irwin): rg starts suspended so it can't spawn anything before it's in its job. It inherits
+// the pipe's write end and nothing else, whatever other handles happen to be inheritable.
+static bool spawn_command(Launcher *launcher, Command *command, wchar_t *command_line)
+{
+    command->spawn_timestamp = get_timestamp();
+
+    SECURITY_ATTRIBUTES saAttr;
+    saAttr.nLength = sizeof(SECURITY_ATTRIBUTES);
+    saAttr.bInheritHandle = TRUE;
+    saAttr.lpSecurityDescriptor = NULL;
+
+    if (!CreatePipe(&command->stdout_read, &command->stdout_write, &saAttr, INGEST_PIPE_SIZE))
+    {
+        Win32OutputLastError();
+        return false;
+    }
+    track_handle_opened(command->stdout_read);
+    track_handle_opened(command->stdout_write);
+
+    bool spawned = false;
+    if (!SetHandleInformation(command->stdout_read, HANDLE_FLAG_INHERIT, 0))
+    {
+        Win32OutputLastError();
+    }
+    else
+    {
+        command->job = CreateJobObjectW(0, 0);
+        track_handle_opened(command->job);
+
+        SIZE_T attribute_list_size = launcher->attribute_list_size;
+        LPPROC_THREAD_ATTRIBUTE_LIST attribute_list = (LPPROC_THREAD_ATTRIBUTE_LIST)launcher->attribute_list_storage;
+        launcher->inherited_handle = command->stdout_write;
+
+        if (!command->job || !apply_job_limits(command))
+        {
+            Win32OutputLastError();
+        }
+        else if (!InitializeProcThreadAttributeList(attribute_list, 1, 0, &attribute_list_size))
+        {
+            Win32OutputLastError();
+        }
+        else
+        {
+            if (!UpdateProcThreadAttribute(attribute_list, 0, PROC_THREAD_ATTRIBUTE_HANDLE_LIST, &launcher->inherited_handle, sizeof(HANDLE), 0, 0))
+            {
+                Win32OutputLastError();
+            }
+            else
+            {
+                STARTUPINFOEXW si = {};
+                si.StartupInfo.cb = sizeof(si);
+                si.StartupInfo.hStdOutput = command->stdout_write;
+                si.StartupInfo.dwFlags |= STARTF_USESTDHANDLES;
+                si.lpAttributeList = attribute_list;
+
+                DWORD creation_flags = CREATE_NO_WINDOW | CREATE_SUSPENDED | EXTENDED_STARTUPINFO_PRESENT;
+                if (CreateProcessW(0, command_line, 0, 0, true, creation_flags, 0, 0, &si.StartupInfo, &command->process_information) != 0)
+                {
+                    track_handle_opened(command->process_information.hProcess);
+                    track_handle_opened(command->process_information.hThread);
+
+                    if (AssignProcessToJobObject(command->job, command->process_information.hProcess))
+                    {
+                        ResumeThread(command->process_information.hThread);
+                        spawned = true;
+                    }
+                    else
+                    {
+                        Win32OutputLastError();
+                        TerminateProcess(command->process_information.hProcess, 1);
+                        close_tracked_handle(&command->process_information.hProcess);
+                    }
+                    close_tracked_handle(&command->process_information.hThread);
+                }
+                else
+                {
+                    Win32OutputLastError();
+                }
+            }
+            DeleteProcThreadAttributeList(attribute_list);
+        }
+        launcher->inherited_handle = 0;
+    }
+
+    // NOTE(irwin): rg holds the only write end now, so the pipe breaks as soon as it exits
+    close_tracked_handle(&command->stdout_write);
+    if (!spawned)
+    {
+        close_tracked_handle(&command->stdout_read);
+        close_tracked_handle(&command->job);
+        InterlockedIncrement(&g_ProcessCounters.spawn_failed);
+        return false;
+    }
+
+    command->spawned_timestamp = get_timestamp();
+    InterlockedIncrement(&g_ProcessCounters.spawned);
+    InterlockedIncrement(&g_ProcessCounters.running);
+    return true;
+}
+
+// NOTE(irwin): fixed cost of every keystroke-triggered search, recorded by the ui thread when a
+// run is finished. spawn is CreatePipe..ResumeThread, first byte is measured from spawn start.
+static const int LAUNCH_STATS_HISTORY = 64;
+
+struct Launch_Stats
+{
+    float spawn_ms[LAUNCH_STATS_HISTORY];
+    float first_byte_ms[LAUNCH_STATS_HISTORY];
+    int spawn_count;
+    int first_byte_count;
+};
+
+static Launch_Stats g_LaunchStats;
+
+static void record_launch_stats(Command *command)
+{
+    if (command->spawned_timestamp)
+    {
+        g_LaunchStats.spawn_ms[g_LaunchStats.spawn_count % LAUNCH_STATS_HISTORY] = timestamp_to_ms(command->spawned_timestamp - command->spawn_timestamp);
+        g_LaunchStats.spawn_count++;
+    }
+    if (command->first_byte_timestamp)
+    {
+        g_LaunchStats.first_byte_ms[g_LaunchStats.first_byte_count % LAUNCH_STATS_HISTORY] = timestamp_to_ms(command->first_byte_timestamp - command->spawn_timestamp);
+        g_LaunchStats.first_byte_count++;
+    }
+}
+
+// NOTE(irwin): byte_budget <= 0 means unlimited
+static bool start_ingest_thread(Command *command, Result_Store *store, HANDLE wake_event, long long byte_budget)
+{
+    command->store = store;
+    command->wake_event = wake_event;
+    command->ingest_done = 0;
+    command->byte_budget = byte_budget > 0 ? byte_budget : LLONG_MAX;
+    command->resume_event = CreateEventW(0, FALSE, FALSE, 0);
+    if (!command->resume_event)
+    {
+        Win32OutputLastError();
+        return false;
+    }
+    track_handle_opened(command->resume_event);
+
+    command->ingest_thread = CreateThread(0, 0, ingest_thread_proc, command, 0, 0);
+    if (!command->ingest_thread)
+    {
+        Win32OutputLastError();
+        return false;
+    }
+    track_handle_opened(command->ingest_thread);
+    return true;
+}
+
+static inline bool is_ingest_done(Command *command)
+{
+    return InterlockedCompareExchange(&command->ingest_done, 0, 0) != 0;
+}
+
+// NOTE(irwin): safe while the run is alive, the job handle is only closed by finish_ingest_thread
+static void set_command_foreground(Command *command, bool foreground)
+{
+    if (command->foreground != foreground && command->job)
+    {
+        command->foreground = foreground;
+        apply_job_limits(command);
+    }
+}
+
+static inline bool is_ingest_paused(Command *command)
+{
+    return InterlockedCompareExchange(&command->ingest_paused, 0, 0) != 0;
+}
+
+// NOTE(irwin): ntdll exports, there's no documented way to suspend another process or to set its
+// io priority. Looked up once at startup, any of them may be missing.
+typedef LONG (NTAPI *Nt_Suspend_Process)(HANDLE process);
+typedef LONG (NTAPI *Nt_Resume_Process)(HANDLE process);
+typedef LONG (NTAPI *Nt_Set_Information_Process)(HANDLE process, int information_class, void *information, ULONG information_size);
+
+struct Nt_Api
+{
+    Nt_Suspend_Process suspend_process;
+    Nt_Resume_Process resume_process;
+    Nt_Set_Information_Process set_information_process;
+};
+
+static Nt_Api g_NtApi;
+
+// NOTE(irwin): PROCESS_INFORMATION_CLASS ProcessIoPriority and IO_PRIORITY_HINT values
+static const int NT_PROCESS_IO_PRIORITY = 33;
+static const ULONG NT_IO_PRIORITY_VERY_LOW = 0;
+static const ULONG NT_IO_PRIORITY_NORMAL = 2;
+
+static void nt_api_init(Nt_Api *api)
+{
+    HMODULE ntdll = GetModuleHandleW(L"ntdll.dll");
+    if (ntdll)
+    {
+        api->suspend_process = (Nt_Suspend_Process)(void *)GetProcAddress(ntdll, "NtSuspendProcess");
+        api->resume_process = (Nt_Resume_Process)(void *)GetProcAddress(ntdll, "NtResumeProcess");
+        api->set_information_process = (Nt_Set_Information_Process)(void *)GetProcAddress(ntdll, "NtSetInformationProcess");
+    }
+}
+
+// NOTE(irwin): cpu priority goes through the job so --pre children get it too, io priority can only
+// be set on rg itself. Same lifetime rules as set_command_foreground.
+static void set_command_throttled(Command *command, bool throttled)
+{
+    if (command->throttled != throttled && command->job)
+    {
+        command->throttled = throttled;
+        apply_job_limits(command);
+        if (g_NtApi.set_information_process && command->process_information.hProcess)
+        {
+            ULONG io_priority = throttled ? NT_IO_PRIORITY_VERY_LOW : NT_IO_PRIORITY_NORMAL;
+            g_NtApi.set_information_process(command->process_information.hProcess, NT_PROCESS_IO_PRIORITY, &io_priority, sizeof(io_priority));
+        }
+    }
+}
+
+// NOTE(irwin): only rg's own threads, whatever it spawned keeps running but has nobody to feed.
+// A suspended rg still dies with its job, cancel_command doesn't need to resume it first.
+static void set_command_suspended(Command *command, bool suspended)
+{
+    if (command->suspended != suspended && command->process_information.hProcess && g_NtApi.suspend_process && g_NtApi.resume_process)
+    {
+        LONG status = suspended ? g_NtApi.suspend_process(command->process_information.hProcess)
+                                : g_NtApi.resume_process(command->process_information.hProcess);
+        if (status >= 0)
+        {
+            command->suspended = suspended;
+            if (suspended)
+            {
+                InterlockedIncrement(&g_ProcessCounters.suspended);
+            }
+            else
+            {
+                InterlockedDecrement(&g_ProcessCounters.suspended);
+            }
+        }
+    }
+}
+
+// NOTE(irwin): non-blocking, the ingest thread notices the broken pipe (or the abort, if it was
+// paused) and reaps rg on its own
+static void cancel_command(Command *command)
+{
+    if (command->started && !command->abort_requested && !is_ingest_done(command))
+    {
+        command->abort_requested = true;
+        InterlockedExchange(&command->abort_signaled, 1);
+        if (command->remote)
+        {
+            CancelIoEx(command->stdout_read, 0);
+        }
+        else
+        {
+            TerminateJobObject(command->job, 1);
+        }
+        SetEvent(command->resume_event);
+        InterlockedIncrement(&g_ProcessCounters.cancelled);
+    }
+}
+
+static void continue_command(Command *command, long long more_bytes)
+{
+    if (command->started && !is_ingest_done(command))
+    {
+        InterlockedExchangeAdd64(&command->byte_budget, more_bytes);
+        SetEvent(command->resume_event);
+    }
+}
+
+// NOTE(irwin): waits for the ingest thread and closes everything the run opened, only blocks if
+// the thread isn't done yet (shutdown)
+static void finish_ingest_thread(Command *command)
+{
+    if (command->ingest_thread)
+    {
+        WaitForSingleObject(command->ingest_thread, INFINITE);
+        close_tracked_handle(&command->ingest_thread);
+        record_launch_stats(command);
+    }
+    if (command->suspended)
+    {
+        command->suspended = false;
+        InterlockedDecrement(&g_ProcessCounters.suspended);
+    }
+    close_tracked_handle(&command->stdout_read);
+    close_tracked_handle(&command->process_information.hProcess);
+    close_tracked_handle(&command->job);
+    close_tracked_handle(&command->resume_event);
+    command->started = false;
+}
+
+// NOTE(irwin): rows ordered by (path, line) without asking rg for --sort, which makes it single
+// threaded. Each batch of newly published rows is sorted on its own and appended to `order` as
+// a run, then runs are merged from the tail while the one before is no bigger than twice the last,
+// so there are O(log n) runs and each row gets moved O(log n) times overall. The table reads
+// ranks through sorted_view_select, a k-way merge from a split found by binary search, so no full
+// merged order is ever built. Ui thread only, and only for stores that aren't spilled since the
+// comparisons read the rows in place.
+struct Sorted_View
+{
+    // NOTE(irwin): rows [0, order.Size) of the store, run i is order[run_starts[i], run_starts[i+1])
+    ImVector<int> order;
+    ImVector<int> run_starts;
+    ImVector<int> scratch;
+
+    // NOTE(irwin): split positions per run for split_rank, valid while split_order_size == order.Size
+    ImVector<int> split;
+    int split_rank;
+    int split_order_size;
+};
+
+struct Sort_Context
+{
+    const ParsedLine *rows;
+    Result_Store *store;
+};
+
+// NOTE(irwin): the row index breaks ties so the order is total and identical between runs of the
+// same search
+static inline int compare_rows_by_path(const Sort_Context *context, int a, int b)
+{
+    const ParsedLine *row_a = context->rows + a;
+    const ParsedLine *row_b = context->rows + b;
+    int result = 0;
+    if (row_a->path_id != row_b->path_id)
+    {
+        result = strcmp(result_store_path(context->store, row_a->path_id), result_store_path(context->store, row_b->path_id));
+    }
+    if (result == 0)
+    {
+        result = row_a->line_number != row_b->line_number ? (row_a->line_number < row_b->line_number ? -1 : 1)
+                                                          : row_a->column - row_b->column;
+    }
+    return result ? result : a - b;
+}
+
+static void merge_sorted_rows(const Sort_Context *context, const int *a, int a_count, const int *b, int b_count, int *out)
+{
+    int a_index = 0;
+    int b_index = 0;
+    while (a_index < a_count && b_index < b_count)
+    {
+        *out++ = compare_rows_by_path(context, b[b_index], a[a_index]) < 0 ? b[b_index++] : a[a_index++];
+    }
+    memcpy(out, a + a_index, (size_t)(a_count - a_index) * sizeof(int));
+    out += a_count - a_index;
+    memcpy(out, b + b_index, (size_t)(b_count - b_index) * sizeof(int));
+}
+
+// NOTE(irwin): top-down merge sort, scratch holds at least `count`
+static void sort_rows_by_path(const Sort_Context *context, int *rows, int count, int *scratch)
+{
+    if (count < 2)
+    {
+        return;
+    }
+    int half = count / 2;
+    sort_rows_by_path(context, rows, half, scratch);
+    sort_rows_by_path(context, rows + half, count - half, scratch);
+    if (compare_rows_by_path(context, rows[half], rows[half - 1]) < 0)
+    {
+        merge_sorted_rows(context, rows, half, rows + half, count - half, scratch);
+        memcpy(rows, scratch, (size_t)count * sizeof(int));
+    }
+}
+
+static inline int sorted_view_run_end(Sorted_View *view, int run)
+{
+    return run + 1 < view->run_starts.Size ? view->run_starts[run + 1] : view->order.Size;
+}
+
+static void sorted_view_merge_last_runs(Sorted_View *view, const Sort_Context *context)
+{
+    int last = view->run_starts.Size - 1;
+    int first = view->run_starts[last - 1];
+    int middle = view->run_starts[last];
+    int end = view->order.Size;
+    view->scratch.resize(end - first);
+    merge_sorted_rows(context, view->order.Data + first, middle - first, view->order.Data + middle, end - middle, view->scratch.Data);
+    memcpy(view->order.Data + first, view->scratch.Data, (size_t)(end - first) * sizeof(int));
+    view->run_starts.pop_back();
+}
+
+// NOTE(irwin): takes in rows published since the last call, amortized O(b log n) for a batch of b
+static void sorted_view_update(Sorted_View *view, Result_Store *store, int row_count)
+{
+    int first_new = view->order.Size;
+    if (row_count <= first_new)
+    {
+        return;
+    }
+
+    Sort_Context context = { (const ParsedLine *)store->rows.base, store };
+    view->order.resize(row_count);
+    for (int row = first_new; row < row_count; ++row)
+    {
+        view->order[row] = row;
+    }
+    view->scratch.resize(row_count - first_new);
+    sort_rows_by_path(&context, view->order.Data + first_new, row_count - first_new, view->scratch.Data);
+    view->run_starts.push_back(first_new);
+
+    while (view->run_starts.Size >= 2)
+    {
+        int last = view->run_starts.Size - 1;
+        int previous_size = view->run_starts[last] - view->run_starts[last - 1];
+        int last_size = view->order.Size - view->run_starts[last];
+        if (previous_size > last_size * 2)
+        {
+            break;
+        }
+        sorted_view_merge_last_runs(view, &context);
+    }
+}
+
+// NOTE(irwin): a single run, `order` is then the whole sorted order
+static void sorted_view_compact(Sorted_View *view, Result_Store *store)
+{
+    Sort_Context context = { (const ParsedLine *)store->rows.base, store };
+    while (view->run_starts.Size >= 2)
+    {
+        sorted_view_merge_last_runs(view, &context);
+    }
+}
+
+// NOTE(irwin): how many rows in the run sort before `row`
+static int sorted_view_lower_bound(Sorted_View *view, const Sort_Context *context, int run, int row)
+{
+    int low = view->run_starts[run];
+    int high = sorted_view_run_end(view, run);
+    while (low < high)
+    {
+        int middle = low + (high - low) / 2;
+        if (compare_rows_by_path(context, view->order[middle], row) < 0)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+static int sorted_view_rank(Sorted_View *view, const Sort_Context *context, int row)
+{
+    int rank = 0;
+    for (int run = 0; run < view->run_starts.Size; ++run)
+    {
+        rank += sorted_view_lower_bound(view, context, run, row) - view->run_starts[run];
+    }
+    return rank;
+}
+
+// NOTE(irwin): split[i] is where rank `rank` starts in run i. The row with that rank is in one of
+// the runs, and within a run ranks only go up, so a binary search per run finds it.
+static void sorted_view_find_split(Sorted_View *view, const Sort_Context *context, int rank)
+{
+    if (view->split_order_size == view->order.Size && view->split_rank == rank && view->split.Size == view->run_starts.Size)
+    {
+        return;
+    }
+    view->split_rank = rank;
+    view->split_order_size = view->order.Size;
+    view->split.resize(view->run_starts.Size);
+    for (int run = 0; run < view->run_starts.Size; ++run)
+    {
+        view->split[run] = rank >= view->order.Size ? sorted_view_run_end(view, run) : view->run_starts[run];
+    }
+    if (rank == 0 || rank >= view->order.Size)
+    {
+        return;
+    }
+
+    for (int run = 0; run < view->run_starts.Size; ++run)
+    {
+        int low = view->run_starts[run];
+        int high = sorted_view_run_end(view, run);
+        while (low < high)
+        {
+            int middle = low + (high - low) / 2;
+            int middle_rank = sorted_view_rank(view, context, view->order[middle]);
+            if (middle_rank == rank)
+            {
+                int row = view->order[middle];
+                for (int other = 0; other < view->run_starts.Size; ++other)
+                {
+                    view->split[other] = sorted_view_lower_bound(view, context, other, row);
+                }
+                return;
+            }
+            if (middle_rank < rank)
+            {
+                low = middle + 1;
+            }
+            else
+            {
+                high = middle;
+            }
+        }
+    }
+}
+
+// NOTE(irwin): row indices of ranks [first_rank, first_rank + count), count must fit
+static void sorted_view_select(Sorted_View *view, Result_Store *store, int first_rank, int count, int *rows)
+{
+    Sort_Context context = { (const ParsedLine *)store->rows.base, store };
+    sorted_view_find_split(view, &context, first_rank);
+
+    int cursor_storage[64];
+    int *cursors = view->split.Size <= IM_ARRAYSIZE(cursor_storage) ? cursor_storage : (int *)malloc((size_t)view->split.Size * sizeof(int));
+    memcpy(cursors, view->split.Data, (size_t)view->split.Size * sizeof(int));
+    for (int index = 0; index < count; ++index)
+    {
+        int best_run = -1;
+        for (int run = 0; run < view->run_starts.Size; ++run)
+        {
+            if (cursors[run] < sorted_view_run_end(view, run) &&
+                (best_run < 0 || compare_rows_by_path(&context, view->order[cursors[run]], view->order[cursors[best_run]]) < 0))
+            {
+                best_run = run;
+            }
+        }
+        rows[index] = view->order[cursors[best_run]++];
+    }
+    if (cursors != cursor_storage)
+    {
+        free(cursors);
+    }
+}
+
+static void sorted_view_release(Sorted_View *view)
+{
+    view->order.clear();
+    view->run_starts.clear();
+    view->scratch.clear();
+    view->split.clear();
+}
+
+static inline long long sorted_view_memory_size(Sorted_View *view)
+{
+    return (long long)(view->order.Capacity + view->run_starts.Capacity + view->scratch.Capacity + view->split.Capacity) * (long long)sizeof(int);
+}
+
+// NOTE(irwin): one rg run and the rows it produced. Lives on the heap so a cancelled search can
+// drain and get reaped in the background while the ui has already moved on to the next one.
+struct Search
+{
+    Command command;
+    Result_Store store;
+    // NOTE(irwin): the --threads the scheduler gave this run
+    int thread_count;
+    // NOTE(irwin): how much more the store may grow each time the user asks for more rows
+    long long byte_budget_step;
+    Search *next_retired;
+
+    // NOTE(irwin): built on first use by tabs that sort by path
+    Sorted_View sorted_view;
+
+    // NOTE(irwin): live mode. A patch run appends the rows of the files that changed to the same
+    // store through a fresh Command, rows they had before are marked in dead_rows. Once patched,
+    // live_rows is what the table shows: every row that isn't dead, sorted by path if
+    // live_rows_sorted.
+    bool patched;
+    bool patch_running;
+    bool live_rows_sorted;
+    ImVector<ImU32> dead_rows;
+    ImVector<int> live_rows;
+
+    // NOTE(irwin): Pause button, keeps rg suspended whatever update_search_priority thinks
+    bool user_paused;
+    // NOTE(irwin): one past the last row the table showed, ui thread. far_ahead_of_reader is set
+    // once rg got more than the scheduler's suspend_rows_ahead rows past it and cleared at half that.
+    int display_end;
+    bool far_ahead_of_reader;
+
+    // NOTE(irwin): everything that decides what rg prints, see build_search_key. Owned, IM_FREE'd
+    // with the search.
+    char *key;
+    ImGuiID key_hash;
+    // NOTE(irwin): last write time of the searched dir when rg was launched, 0 if unknown
+    unsigned long long dir_write_time;
+    Search *cache_prev;
+    Search *cache_next;
+};
+
+static Search *create_search(Output_Format format, int row_fields, bool spill)
+{
+    Search *search = (Search *)calloc(1, sizeof(Search));
+    if (search && !result_store_init(&search->store, format, row_fields, spill))
+    {
+        result_store_release(&search->store);
+        free(search);
+        search = 0;
+    }
+    return search;
+}
+
+static void destroy_search(Search *search)
+{
+    finish_ingest_thread(&search->command);
+    result_store_release(&search->store);
+    sorted_view_release(&search->sorted_view);
+    search->dead_rows.clear();
+    search->live_rows.clear();
+    IM_FREE(search->key);
+    free(search);
+}
+
+static bool start_search(Search *search, wchar_t *command_line, HANDLE wake_event)
+{
+    if (!spawn_command(&g_Launcher, &search->command, command_line))
+    {
+        return false;
+    }
+
+    search->command.started = true;
+    if (!start_ingest_thread(&search->command, &search->store, wake_event, search->byte_budget_step))
+    {
+        TerminateJobObject(search->command.job, 1);
+        WaitForSingleObject(search->command.process_information.hProcess, INFINITE);
+        InterlockedDecrement(&g_ProcessCounters.running);
+        InterlockedIncrement(&g_ProcessCounters.reaped);
+        finish_ingest_thread(&search->command);
+        return false;
+    }
+    return true;
+}
+
+// NOTE(irwin): cancelled searches wait here until their ingest thread is done
+static Search *g_RetiredSearches = nullptr;
+static int g_RetiredSearchCount = 0;
+
+static void retire_search(Search *search)
+{
+    cancel_command(&search->command);
+    search->next_retired = g_RetiredSearches;
+    g_RetiredSearches = search;
+    g_RetiredSearchCount++;
+}
+
+static void reap_retired_searches(bool wait)
+{
+    Search **link = &g_RetiredSearches;
+    while (*link)
+    {
+        Search *search = *link;
+        if (wait || !search->command.started || is_ingest_done(&search->command))
+        {
+            *link = search->next_retired;
+            g_RetiredSearchCount--;
+            destroy_search(search);
+        }
+        else
+        {
+            link = &search->next_retired;
+        }
+    }
+}
+
+// NOTE(irwin): "line" or "line:column" written backwards from the end of buffer, no printf. Returns
+// where it starts, an empty string when rg didn't print a line number.
+static const int ROW_LOCATION_CAPACITY = 24;
+
+static char *format_row_location(const ParsedLine *line, char *buffer_end)
+{
+    char *at = buffer_end;
+    if (line->line_number <= 0)
+    {
+        return at;
+    }
+    if (line->column > 0)
+    {
+        for (int value = line->column; value > 0; value /= 10)
+        {
+            *--at = (char)('0' + value % 10);
+        }
+        *--at = ':';
+    }
+    for (int value = line->line_number; value > 0; value /= 10)
+    {
+        *--at = (char)('0' + value % 10);
+    }
+    return at;
+}
+
+// NOTE(irwin): whitespace separated tokens, -j may be bundled with other short flags (-nj4)
+static bool command_has_threads_flag(const char *command)
+{
+    const char *at = command;
+    while (*at)
+    {
+        while (*at == ' ' || *at == '\t')
+        {
+            at++;
+        }
+        const char *token = at;
+        while (*at && *at != ' ' && *at != '\t')
+        {
+            at++;
+        }
+
+        if (token[0] == '-' && token[1] == '-')
+        {
+            if (at - token >= 9 && memcmp(token, "--threads", 9) == 0)
+            {
+                return true;
+            }
+        }
+        else if (token[0] == '-')
+        {
+            for (const char *ch = token + 1; ch < at; ++ch)
+            {
+                if (*ch == 'j')
+                {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+// NOTE(irwin): everything up to and including the query, the caller appends what to search.
+// rg leaves the path out when it's given a single file, with_filename keeps it in.
+static void launcher_begin_search_command(const char *search_command, bool ignore_case, Output_Format output_format, int row_fields,
+                                          const char *query, int thread_count, bool with_filename)
+{
+    launcher_begin(&g_Launcher);
+    launcher_append_raw(&g_Launcher, search_command);
+    if (ignore_case)
+    {
+        launcher_append_argument(&g_Launcher, "-i");
+    }
+    if (output_format == Output_Format_Json)
+    {
+        launcher_append_argument(&g_Launcher, "--json");
+    }
+    else if (output_format == Output_Format_Null)
+    {
+        launcher_append_argument(&g_Launcher, "--null");
+    }
+    else if (output_format == Output_Format_Heading)
+    {
+        launcher_append_argument(&g_Launcher, "--heading");
+    }
+    if (row_fields & Row_Field_Column)
+    {
+        launcher_append_argument(&g_Launcher, "--column");
+    }
+    if (row_fields & Row_Field_Byte_Offset)
+    {
+        launcher_append_argument(&g_Launcher, "--byte-offset");
+    }
+    if (with_filename)
+    {
+        launcher_append_argument(&g_Launcher, "--with-filename");
+    }
+    // NOTE(irwin): an explicit -j/--threads in the user's command wins
+    if (!command_has_threads_flag(search_command))
+    {
+        char threads_argument[32];
+        ImFormatString(threads_argument, IM_ARRAYSIZE(threads_argument), "--threads=%d", thread_count);
+        launcher_append_argument(&g_Launcher, threads_argument);
+    }
+    // NOTE(irwin): query and dir are arguments on their own, even if they start with '-' or contain spaces
+    launcher_append_argument(&g_Launcher, "--");
+    launcher_append_argument(&g_Launcher, query);
+}
+
+// NOTE(irwin): a query and the dir to search it in, from the command line or from another barerg,
+// see Instance_Server
+struct Instance_Request
+{
+    char query[1024];
+    char dir[1024];
+};
+
+// NOTE(irwin): `barerg [options] [query [dir]]`, dir defaults to the current directory.
+//   --new-instance     don't hand the query to a running barerg
+//   --headless         run the query without a window and print stats, see run_headless
+//   --dump             headless, also print every row as path:line:text
+//   --format=FORMAT    headless, text|json|null|heading
+//   --command=COMMAND  headless, rg and its flags, "rg.exe --line-number" by default
+//   --threads=N        headless, rg --threads
+//   --column, --byte-offset
+//                      headless, have rg print them and dump them like rg does
+//   -i, --spill        headless, ignore case and spill to disk like the tab checkboxes
+//   --stress=GB        headless, parse GB GiB of synthetic output instead of running rg and check
+//                      every row, see check_stress_rows
+//   --stress-output=GB print that output to stdout, it's what --stress runs
+//   --daemon           run the search daemon, see run_search_daemon
+//   --daemon-cache-mb=N, --daemon-max-age=SECONDS
+//                      how much finished output the daemon keeps and for how long
+struct Command_Line_Options
+{
+    Instance_Request request;
+    bool new_instance;
+
+    bool daemon;
+    int daemon_cache_mb;
+    int daemon_max_age_seconds;
+
+    bool headless;
+    bool dump;
+    bool ignore_case;
+    bool spill;
+    int stress_gb;
+    int stress_output_gb;
+    int thread_count;
+    Output_Format output_format;
+    int row_fields;
+    char search_command[1024];
+};
+
+static bool parse_command_line(Command_Line_Options *options)
+{
+    *options = {};
+    ImStrncpy(options->search_command, "rg.exe --line-number", IM_ARRAYSIZE(options->search_command));
+    options->thread_count = ImMax(1, (int)GetActiveProcessorCount(ALL_PROCESSOR_GROUPS));
+    options->daemon_cache_mb = 1024;
+    options->daemon_max_age_seconds = 30;
+
+    int argument_count = 0;
+    wchar_t **arguments = CommandLineToArgvW(GetCommandLineW(), &argument_count);
+    if (!arguments)
+    {
+        return false;
+    }
+
+    Instance_Request *request = &options->request;
+    int positional = 0;
+    bool valid = true;
+    for (int index = 1; index < argument_count; ++index)
+    {
+        char argument[1024];
+        WideCharToMultiByte(CP_UTF8, 0, arguments[index], -1, argument, IM_ARRAYSIZE(argument), 0, 0);
+        argument[IM_ARRAYSIZE(argument) - 1] = 0;
+
+        if (strcmp(argument, "--new-instance") == 0)
+        {
+            options->new_instance = true;
+        }
+        else if (strcmp(argument, "--daemon") == 0)
+        {
+            options->daemon = true;
+        }
+        else if (strncmp(argument, "--daemon-cache-mb=", 18) == 0)
+        {
+            options->daemon_cache_mb = ImMax(0, atoi(argument + 18));
+        }
+        else if (strncmp(argument, "--daemon-max-age=", 17) == 0)
+        {
+            options->daemon_max_age_seconds = ImMax(0, atoi(argument + 17));
+        }
+        else if (strcmp(argument, "--headless") == 0)
+        {
+            options->headless = true;
+        }
+        else if (strcmp(argument, "--dump") == 0)
+        {
+            options->dump = true;
+        }
+        else if (strcmp(argument, "--spill") == 0)
+        {
+            options->spill = true;
+        }
+        else if (strcmp(argument, "-i") == 0)
+        {
+            options->ignore_case = true;
+        }
+        else if (strcmp(argument, "--column") == 0)
+        {
+            options->row_fields |= Row_Field_Column;
+        }
+        else if (strcmp(argument, "--byte-offset") == 0)
+        {
+            options->row_fields |= Row_Field_Byte_Offset;
+        }
+        else if (strncmp(argument, "--threads=", 10) == 0)
+        {
+            options->thread_count = ImMax(1, atoi(argument + 10));
+        }
+        else if (strncmp(argument, "--stress=", 9) == 0)
+        {
+            options->stress_gb = ImMax(1, atoi(argument + 9));
+        }
+        else if (strncmp(argument, "--stress-output=", 16) == 0)
+        {
+            options->stress_output_gb = ImMax(1, atoi(argument + 16));
+        }
+        else if (strncmp(argument, "--command=", 10) == 0)
+        {
+            ImStrncpy(options->search_command, argument + 10, IM_ARRAYSIZE(options->search_command));
+        }
+        else if (strncmp(argument, "--format=", 9) == 0)
+        {
+            static const char *format_names[Output_Format_COUNT] = { "text", "json", "null", "heading" };
+            valid = false;
+            for (int format = 0; format < Output_Format_COUNT; ++format)
+            {
+                if (strcmp(argument + 9, format_names[format]) == 0)
+                {
+                    options->output_format = (Output_Format)format;
+                    valid = true;
+                }
+            }
+        }
+        else if (positional == 0)
+        {
+            ImStrncpy(request->query, argument, IM_ARRAYSIZE(request->query));
+            positional++;
+        }
+        else if (positional == 1)
+        {
+            ImStrncpy(request->dir, argument, IM_ARRAYSIZE(request->dir));
+            positional++;
+        }
+    }
+    LocalFree(arguments);
+
+    if (request->query[0] && !request->dir[0])
+    {
+        wchar_t current_dir[MAX_PATH * 2];
+        DWORD size = GetCurrentDirectoryW(IM_ARRAYSIZE(current_dir), current_dir);
+        if (size > 0 && size < IM_ARRAYSIZE(current_dir))
+        {
+            WideCharToMultiByte(CP_UTF8, 0, current_dir, -1, request->dir, IM_ARRAYSIZE(request->dir), 0, 0);
+        }
+    }
+    return valid;
+}
+
+// NOTE(irwin): rows [*dumped_rows, published) to stdout, a window at a time so spilled stores
+// work too
+static void dump_new_rows(Result_Store *store, int *dumped_rows)
+{
+    int row_count = result_store_published_row_count(store);
+    while (*dumped_rows < row_count)
+    {
+        int first_row = *dumped_rows;
+        int batch = ImMin(4096, row_count - first_row);
+        Result_Window window;
+        if (!result_store_window(store, first_row, batch, &window))
+        {
+            return;
+        }
+        for (int row = first_row; row < first_row + batch; ++row)
+        {
+            ParsedLine line = result_window_row(&window, row);
+            fwrite(result_store_path(store, line.path_id), 1, (size_t)result_store_path_size(store, line.path_id), stdout);
+            fputc(':', stdout);
+            char location[ROW_LOCATION_CAPACITY];
+            char *location_end = location + IM_ARRAYSIZE(location);
+            char *location_first = format_row_location(&line, location_end);
+            fwrite(location_first, 1, (size_t)(location_end - location_first), stdout);
+            if (store->row_fields & Row_Field_Byte_Offset)
+            {
+                fprintf(stdout, ":%lld", line.absolute_offset);
+            }
+            fputc(':', stdout);
+            fwrite(window.text + line.match.first, 1, (size_t)(line.match.one_past_last - line.match.first), stdout);
+            fputc('\n', stdout);
+        }
+        *dumped_rows += batch;
+    }
+}
+
+// NOTE(irwin): synthetic rg output for `--headless --stress`, row by row, so it can be printed by
+// one process and checked by another without either holding it. 1000 rows per file and 64 files
+// per directory, so paths and the path table get exercised too. Offsets get past 4 GB early.
+static const long long STRESS_ROWS_PER_FILE = 1000;
+static const long long STRESS_FILES_PER_DIR = 64;
+static const long long STRESS_OFFSET_STRIDE = 100003;
+static const int STRESS_ROW_CAPACITY = 512;
+static const size_t STRESS_WRITE_SIZE = 1024 * 1024;
+static const char STRESS_PADDING[] = "................................................................";
+static const char STRESS_NEEDLE[] = "needle";
+
+struct Stress_Row
+{
+    char path[64];
+    int path_size;
+    char match[128];
+    int match_size;
+    int line_number;
+    long long absolute_offset;
+    // NOTE(irwin): the needle in the match, it's what rg's column and json submatch point at
+    Row_Span needle;
+};
+
+static void stress_row(long long row, Stress_Row *result)
+{
+    long long file = row / STRESS_ROWS_PER_FILE;
+    result->path_size = ImFormatString(result->path, IM_ARRAYSIZE(result->path), "stress/d%05lld/f%07lld.log", file / STRESS_FILES_PER_DIR, file);
+    result->match_size = ImFormatString(result->match, IM_ARRAYSIZE(result->match), "row %012lld %.*s%s", row, (int)(row % 64), STRESS_PADDING, STRESS_NEEDLE);
+    result->line_number = (int)(row % STRESS_ROWS_PER_FILE) + 1;
+    result->absolute_offset = row * STRESS_OFFSET_STRIDE;
+    result->needle.one_past_last = result->match_size;
+    result->needle.first = result->match_size - (int)(IM_ARRAYSIZE(STRESS_NEEDLE) - 1);
+}
+
+// NOTE(irwin): the row the way rg prints it in `format`, with the heading format's path line and
+// the empty line before it when the row starts a file. Returns the size, at most
+// STRESS_ROW_CAPACITY.
+static int format_stress_row(Output_Format format, int row_fields, long long row, const Stress_Row *stress, char *buffer)
+{
+    if (format == Output_Format_Json)
+    {
+        return ImFormatString(buffer, STRESS_ROW_CAPACITY,
+                              "{\"type\":\"match\",\"data\":{\"path\":{\"text\":\"%s\"},\"lines\":{\"text\":\"%s\\n\"},\"line_number\":%d,"
+                              "\"absolute_offset\":%lld,\"submatches\":[{\"match\":{\"text\":\"%s\"},\"start\":%d,\"end\":%d}]}}\n",
+                              stress->path, stress->match, stress->line_number, stress->absolute_offset, STRESS_NEEDLE,
+                              stress->needle.first, stress->needle.one_past_last);
+    }
+
+    char *at = buffer;
+    char *end = buffer + STRESS_ROW_CAPACITY;
+    if (format == Output_Format_Heading)
+    {
+        if (stress->line_number == 1)
+        {
+            at += ImFormatString(at, (size_t)(end - at), "%s%s\n", row > 0 ? "\n" : "", stress->path);
+        }
+    }
+    else
+    {
+        memcpy(at, stress->path, (size_t)stress->path_size);
+        at += stress->path_size;
+        *at++ = format == Output_Format_Null ? '\0' : ':';
+    }
+    at += ImFormatString(at, (size_t)(end - at), "%d:", stress->line_number);
+    if (row_fields & Row_Field_Column)
+    {
+        at += ImFormatString(at, (size_t)(end - at), "%d:", stress->needle.first + 1);
+    }
+    if (row_fields & Row_Field_Byte_Offset)
+    {
+        at += ImFormatString(at, (size_t)(end - at), "%lld:", stress->absolute_offset);
+    }
+    at += ImFormatString(at, (size_t)(end - at), "%s\n", stress->match);
+    return (int)(at - buffer);
+}
+
+// NOTE(irwin): `barerg --stress-output=GB`, rows until at least GB GiB are out. The format is
+// --format's, the launcher's rg flags after it are ignored apart from --column and --byte-offset.
+static int write_stress_output(Command_Line_Options *options)
+{
+    HANDLE output = GetStdHandle(STD_OUTPUT_HANDLE);
+    char *buffer = (char *)malloc(STRESS_WRITE_SIZE);
+    if (!output || !buffer)
+    {
+        free(buffer);
+        return 2;
+    }
+
+    // NOTE(irwin): fails once the reader is gone, e.g. the headless run gave up
+    long long limit = (long long)options->stress_output_gb << 30;
+    long long written = 0;
+    size_t used = 0;
+    bool ok = true;
+    for (long long row = 0; ok && written < limit; ++row)
+    {
+        Stress_Row stress;
+        stress_row(row, &stress);
+        int size = format_stress_row(options->output_format, options->row_fields, row, &stress, buffer + used);
+        used += (size_t)size;
+        written += size;
+        if (used + STRESS_ROW_CAPACITY > STRESS_WRITE_SIZE || written >= limit)
+        {
+            DWORD write_size = 0;
+            ok = WriteFile(output, buffer, (DWORD)used, &write_size, 0) && write_size == used;
+            used = 0;
+        }
+    }
+    free(buffer);
+    return ok ? 0 : 2;
+}
+
+// NOTE(irwin): every row of a finished --stress run against the row it was made from, and the
+// bytes they add up to against what was read, so a row lost or a field cut to 32 bits anywhere
+// past the 2 and 4 GB marks shows up. Prints the first row that's wrong.
+static bool check_stress_rows(Result_Store *store, int stress_gb)
+{
+    int row_count = result_store_published_row_count(store);
+    bool is_json = store->format == Output_Format_Json;
+    int wrong_rows = 0;
+    long long bytes = 0;
+    int last_row_size = 0;
+    char buffer[STRESS_ROW_CAPACITY];
+    for (int first_row = 0; first_row < row_count; first_row += 4096)
+    {
+        int batch = ImMin(4096, row_count - first_row);
+        Result_Window window;
+        if (!result_store_window(store, first_row, batch, &window))
+        {
+            fprintf(stderr, "stress: couldn't map rows %d..%d\n", first_row, first_row + batch);
+            return false;
+        }
+        for (int row = first_row; row < first_row + batch; ++row)
+        {
+            Stress_Row stress;
+            stress_row(row, &stress);
+            last_row_size = format_stress_row(store->format, store->row_fields, row, &stress, buffer);
+            bytes += last_row_size;
+
+            ParsedLine line = result_window_row(&window, row);
+            int expected_column = is_json || (store->row_fields & Row_Field_Column) ? stress.needle.first + 1 : 0;
+            long long expected_offset = is_json || (store->row_fields & Row_Field_Byte_Offset) ? stress.absolute_offset : -1;
+            bool same = line.line_number == stress.line_number && line.column == expected_column && line.absolute_offset == expected_offset &&
+                        result_store_path_size(store, line.path_id) == stress.path_size &&
+                        memcmp(result_store_path(store, line.path_id), stress.path, (size_t)stress.path_size) == 0 &&
+                        line.match.one_past_last - line.match.first == stress.match_size &&
+                        memcmp(window.text + line.match.first, stress.match, (size_t)stress.match_size) == 0;
+            if (same && is_json)
+            {
+                Row_Span needle = parsed_line_submatch_count(&line) == 1 ? parsed_line_submatch(window.text, &line, 0) : Row_Span{};
+                same = needle.first == stress.needle.first && needle.one_past_last == stress.needle.one_past_last;
+            }
+            if (!same && wrong_rows++ == 0)
+            {
+                fprintf(stderr, "stress: row %d at byte %lld is wrong, expected %s:%d %s\n", row, bytes - last_row_size, stress.path,
+                        stress.line_number, stress.match);
+            }
+        }
+    }
+
+    long long limit = (long long)stress_gb << 30;
+    bool complete = bytes == store->bytes_read && bytes >= limit && bytes - last_row_size < limit;
+    fprintf(stderr, "stress: %d rows, %lld bytes checked, %d wrong%s\n", row_count, bytes, wrong_rows, complete ? "" : ", rows missing");
+    return wrong_rows == 0 && complete;
+}
+
+static inline bool has_std_handle(DWORD which)
+{
+    HANDLE handle = GetStdHandle(which);
+    return handle && handle != INVALID_HANDLE_VALUE;
+}
+
+// NOTE(irwin): a /SUBSYSTEM:WINDOWS process only has the std handles that were redirected. The
+// missing ones print to the console we were started from, the redirected ones stay as they are.
+static void attach_parent_console()
+{
+    bool has_stdout = has_std_handle(STD_OUTPUT_HANDLE);
+    bool has_stderr = has_std_handle(STD_ERROR_HANDLE);
+    if ((has_stdout && has_stderr) || !AttachConsole(ATTACH_PARENT_PROCESS))
+    {
+        return;
+    }
+    if (!has_stdout)
+    {
+        freopen("CONOUT$", "w", stdout);
+    }
+    if (!has_stderr)
+    {
+        freopen("CONOUT$", "w", stderr);
+    }
+}
+
+// NOTE(irwin): the same launcher, ingest thread, parsers and result store a tab uses, without a
+// window or d3d. Stats go to stderr and rows to stdout, so `barerg --headless --dump q dir > rows`
+// works from a console or a CI script. Returns rg's exit code, 2 if rg couldn't be run.
+static int run_headless(Command_Line_Options *options, bool options_valid)
+{
+    attach_parent_console();
+    // NOTE(irwin): --stress runs this exe in place of rg, the query and dir are only there because
+    // the launcher wants them
+    Instance_Request *request = &options->request;
+    if (options_valid && options->stress_gb > 0)
+    {
+        static const char *format_names[Output_Format_COUNT] = { "text", "json", "null", "heading" };
+        wchar_t module_path[MAX_PATH * 2];
+        char module_path_utf8[MAX_PATH * 4];
+        DWORD module_path_size = GetModuleFileNameW(0, module_path, IM_ARRAYSIZE(module_path));
+        options_valid = module_path_size > 0 && module_path_size < IM_ARRAYSIZE(module_path) &&
+                        WideCharToMultiByte(CP_UTF8, 0, module_path, -1, module_path_utf8, IM_ARRAYSIZE(module_path_utf8), 0, 0) > 0;
+        ImFormatString(options->search_command, IM_ARRAYSIZE(options->search_command), "\"%s\" --stress-output=%d --format=%s", module_path_utf8,
+                       options->stress_gb, format_names[options->output_format]);
+        ImStrncpy(request->query, "stress", IM_ARRAYSIZE(request->query));
+        ImStrncpy(request->dir, ".", IM_ARRAYSIZE(request->dir));
+    }
+    if (!options_valid || !request->query[0])
+    {
+        fprintf(stderr, "usage: barerg --headless [--dump] [--format=text|json|null|heading] [--command=\"rg.exe --line-number\"]\n"
+                        "                         [--threads=N] [-i] [--spill] [--column] [--byte-offset] query [dir]\n"
+                        "       barerg --headless --stress=GB [--format=...] [--spill] [--column] [--byte-offset]\n");
+        return 2;
+    }
+
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    g_TimestampFrequency = frequency.QuadPart;
+    if (!launcher_init(&g_Launcher))
+    {
+        return 2;
+    }
+    nt_api_init(&g_NtApi);
+    virtual_buffer_api_init(&g_VirtualBufferApi);
+
+    launcher_begin_search_command(options->search_command, options->ignore_case, options->output_format, options->row_fields, request->query,
+                                  options->thread_count, false);
+    launcher_append_argument(&g_Launcher, request->dir);
+    wchar_t *command_line = launcher_finish(&g_Launcher);
+    Search *search = command_line ? create_search(options->output_format, options->row_fields, options->spill) : nullptr;
+    if (!search)
+    {
+        fprintf(stderr, "barerg: couldn't build the rg command line\n");
+        return 2;
+    }
+    search->thread_count = options->thread_count;
+    search->command.foreground = true;
+
+    HANDLE wake_event = CreateEventW(0, FALSE, FALSE, 0);
+    if (!wake_event || !start_search(search, command_line, wake_event))
+    {
+        fprintf(stderr, "barerg: couldn't start %s\n", g_Launcher.command_line_utf8);
+        destroy_search(search);
+        return 2;
+    }
+
+    int dumped_rows = 0;
+    while (!is_ingest_done(&search->command))
+    {
+        WaitForSingleObject(wake_event, INFINITE);
+        if (options->dump)
+        {
+            dump_new_rows(&search->store, &dumped_rows);
+        }
+    }
+    finish_ingest_thread(&search->command);
+    long long exit_timestamp = get_timestamp();
+    if (options->dump)
+    {
+        dump_new_rows(&search->store, &dumped_rows);
+        fflush(stdout);
+    }
+
+    Result_Store *store = &search->store;
+    Command *command = &search->command;
+    float parse_ms = timestamp_to_ms(store->parse_ticks);
+    double megabytes = (double)store->bytes_read / (1024.0 * 1024.0);
+    PROCESS_MEMORY_COUNTERS memory_counters = {};
+    memory_counters.cb = sizeof(memory_counters);
+    GetProcessMemoryInfo(GetCurrentProcess(), &memory_counters, sizeof(memory_counters));
+
+    fprintf(stderr, "command: %s\n", g_Launcher.command_line_utf8);
+    fprintf(stderr, "rows: %d\n", result_store_published_row_count(store));
+    fprintf(stderr, "bytes: %lld (%.1f MB)\n", store->bytes_read, megabytes);
+    fprintf(stderr, "parse: %.2f ms, %.1f MB/s\n", parse_ms, megabytes * 1000.0 / ImMax((double)parse_ms, 0.001));
+    fprintf(stderr, "spawn: %.2f ms\n", timestamp_to_ms(command->spawned_timestamp - command->spawn_timestamp));
+    if (command->first_byte_timestamp)
+    {
+        fprintf(stderr, "first byte: %.2f ms\n", timestamp_to_ms(command->first_byte_timestamp - command->spawn_timestamp));
+    }
+    fprintf(stderr, "total: %.2f ms\n", timestamp_to_ms(exit_timestamp - command->spawn_timestamp));
+    fprintf(stderr, "store: %.1f MB text, %.1f MB rows committed%s\n", (double)store->text.committed / (1024.0 * 1024.0),
+            (double)store->rows.committed / (1024.0 * 1024.0), store->spill ? " (spilled)" : "");
+    fprintf(stderr, "paths: %d, %.1f MB of names\n", store->paths.entry_count, (double)store->paths.names.used / (1024.0 * 1024.0));
+    fprintf(stderr, "peak working set: %.1f MB, peak commit: %.1f MB\n", (double)memory_counters.PeakWorkingSetSize / (1024.0 * 1024.0),
+            (double)memory_counters.PeakPagefileUsage / (1024.0 * 1024.0));
+    fprintf(stderr, "rg exit code: %u%s\n", (unsigned)command->exit_code, command->drained ? "" : " (output not fully read)");
+
+    int exit_code = command->drained ? (int)command->exit_code : 2;
+    if (options->stress_gb > 0 && exit_code == 0 && !check_stress_rows(store, options->stress_gb))
+    {
+        exit_code = 1;
+    }
+    destroy_search(search);
+    CloseHandle(wake_event);
+    return exit_code;
+}
@@ -47,6 +47,8 @@ set LINK=/INCREMENTAL:NO
 set "LINK=%LINK% /SUBSYSTEM:WINDOWS"
 set "LINK=%LINK% /ENTRY:mainCRTStartup"
 set "LINK=%LINK% kernel32.lib"
+set "LINK=%LINK% shell32.lib"
+set "LINK=%LINK% advapi32.lib"
 set "LINK=%LINK% d3d11.lib d3dcompiler.lib"
 
 